@@ -0,0 +1,91 @@
+// Consultas em lote x uma por vez: consultas/s de cada estrutura com
+// searchBatch e com o laço de consultas individuais (resultados conferidos).
+//   g++ -std=c++17 -O2 -pthread -o bench_batch bench/bench_batch.cpp
+//   ./bench_batch [N=20000] [consultas=256] [k=10]
+#include "../feature_store.hpp"
+#include "../search_hash.hpp"
+#include "../search_list.hpp"
+#include "../search_mtree.hpp"
+#include "../search_quadtree.hpp"
+#include "../synthetic_dataset.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+using namespace std;
+
+using Answers = vector<vector<Neighbor>>;
+
+static bool sameAnswers(const Answers &a, const Answers &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t q = 0; q < a.size(); q++)
+    {
+        if (a[q].size() != b[q].size()) return false;
+        for (size_t i = 0; i < a[q].size(); i++)
+            if (a[q][i].row != b[q][i].row || a[q][i].distance != b[q][i].distance)
+                return false;
+    }
+    return true;
+}
+
+static double seconds(const function<void()> &fn)
+{
+    auto t1 = chrono::steady_clock::now();
+    fn();
+    return chrono::duration<double>(chrono::steady_clock::now() - t1).count();
+}
+
+static void report(const char *engine, size_t nq, double loopSecs, double batchSecs, bool same)
+{
+    printf("%-9s %14.0f %14.0f %9.2fx %s\n", engine, nq / loopSecs, nq / batchSecs,
+           loopSecs / batchSecs, same ? "ok" : "DIFERENTE");
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000;
+    size_t nq = argc > 2 ? strtoull(argv[2], nullptr, 10) : 256;
+    size_t k = argc > 3 ? strtoull(argv[3], nullptr, 10) : 10;
+
+    FeatureStore store;
+    SyntheticParams synthetic;
+    synthetic.seed = 3;
+    ThreadPool generator;
+    generateSynthetic(store, n + nq, {}, synthetic, generator);
+    vector<uint32_t> base(n);
+    for (uint32_t r = 0; r < n; r++) base[r] = r;
+    vector<const float *> queries(nq);
+    for (size_t q = 0; q < nq; q++) queries[q] = store.row((uint32_t)(n + q));
+
+    SimHashIndex hash(store);
+    hash.build(base);
+    QuadtreeIndex quadtree(store);
+    quadtree.build(base);
+    MTree mtree(store);
+    mtree.bulkLoad(base);
+
+    printf("N=%zu consultas=%zu k=%zu\n", n, nq, k);
+    printf("%-9s %14s %14s %10s\n", "estrutura", "loop cons/s", "batch cons/s", "ganho");
+
+    Answers loop(nq), batch;
+    double tl, tb;
+
+    tl = seconds([&] { for (size_t q = 0; q < nq; q++) loop[q] = searchKnn(store, base, queries[q], k); });
+    tb = seconds([&] { batch = searchBatch(store, base, queries, k); });
+    report("lista", nq, tl, tb, sameAnswers(loop, batch));
+
+    tl = seconds([&] { for (size_t q = 0; q < nq; q++) loop[q] = hash.knn(queries[q], k); });
+    tb = seconds([&] { batch = hash.searchBatch(queries, k); });
+    report("hash", nq, tl, tb, sameAnswers(loop, batch));
+
+    tl = seconds([&] { for (size_t q = 0; q < nq; q++) loop[q] = quadtree.knn(queries[q], k); });
+    tb = seconds([&] { batch = quadtree.searchBatch(queries, k); });
+    report("quadtree", nq, tl, tb, sameAnswers(loop, batch));
+
+    tl = seconds([&] { for (size_t q = 0; q < nq; q++) loop[q] = mtree.knn(queries[q], k); });
+    tb = seconds([&] { batch = mtree.searchBatch(queries, k); });
+    report("m-tree", nq, tl, tb, sameAnswers(loop, batch));
+    return 0;
+}
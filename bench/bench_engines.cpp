@@ -0,0 +1,381 @@
+// Todas as estruturas em vários N: tempo de construção, latência por consulta
+// (p50/p95/p99), consultas/s, memória do índice, distâncias calculadas por
+// consulta e recall@k contra a busca linear exata. Grava CSV e/ou JSON.
+//   g++ -std=c++17 -O2 -pthread -o bench_engines bench/bench_engines.cpp
+//   ./bench_engines [--sizes 1000,10000,100000] [--queries 500] [--k 10]
+//                   [--warmup 50] [--rerank 64] [--csv saida.csv] [--json saida.json]
+//                   [--dataset indice.bin]   (base gerada por "main generate"; padrão: a mesma mistura gerada aqui)
+//                   [--quantize u8|u16|f16]  (mais lista e M-Tree sobre linhas compactas, re-rank exato)
+//                   [--sparse]               (mais lista e M-Tree sobre linhas esparsas)
+//                   [--coarse]               (mais lista e M-Tree com o filtro da pirâmide 8/64 bins)
+#include "../coarse_filter.hpp"
+#include "../feature_store.hpp"
+#include "../index_file.hpp"
+#include "../quantized_store.hpp"
+#include "../search_hash.hpp"
+#include "../search_list.hpp"
+#include "../search_mtree.hpp"
+#include "../search_quadtree.hpp"
+#include "../sparse_store.hpp"
+#include "../synthetic_dataset.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct EngineResult
+{
+    string engine;
+    size_t n = 0;
+    double buildMs = 0;
+    double p50 = 0, p95 = 0, p99 = 0;   // microssegundos
+    double qps = 0;
+    size_t memoryBytes = 0;             // só o índice (as features ficam no store)
+    double distancesPerQuery = 0;
+    double recall = 0;                  // recall@k médio
+};
+
+// Uma consulta: devolve os vizinhos e soma as distâncias calculadas
+using QueryFn = function<vector<Neighbor>(const float *, size_t &)>;
+
+static double msSince(chrono::steady_clock::time_point t)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+}
+
+static double percentile(const vector<double> &sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[min(i, sorted.size() - 1)];
+}
+
+static double recallAtK(const vector<Neighbor> &hits, const vector<Neighbor> &truth)
+{
+    if (truth.empty()) return 1.0;
+    size_t found = 0;
+    for (const Neighbor &t : truth)
+        for (const Neighbor &h : hits)
+            if (h.row == t.row) { found++; break; }
+    return (double)found / truth.size();
+}
+
+static void runQueries(EngineResult &res, const QueryFn &query, const vector<const float *> &queries,
+                       const vector<vector<Neighbor>> &truth, size_t warmup)
+{
+    size_t ignored = 0;
+    for (size_t w = 0; w < warmup; w++)
+        query(queries[w % queries.size()], ignored);
+
+    vector<double> lat(queries.size());
+    size_t distances = 0;
+    double recall = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t q = 0; q < queries.size(); q++)
+    {
+        auto t1 = chrono::steady_clock::now();
+        vector<Neighbor> hits = query(queries[q], distances);
+        lat[q] = chrono::duration<double, micro>(chrono::steady_clock::now() - t1).count();
+        recall += recallAtK(hits, truth[q]);
+    }
+    double totalMs = msSince(start);
+
+    sort(lat.begin(), lat.end());
+    res.p50 = percentile(lat, 0.50);
+    res.p95 = percentile(lat, 0.95);
+    res.p99 = percentile(lat, 0.99);
+    res.qps = totalMs > 0 ? queries.size() / (totalMs / 1000.0) : 0;
+    res.distancesPerQuery = (double)distances / queries.size();
+    res.recall = recall / queries.size();
+}
+
+static void printRow(const EngineResult &r)
+{
+    printf("%-13s %8zu %10.1f %9.1f %9.1f %9.1f %10.0f %11.2f %10.1f %7.3f\n", r.engine.c_str(), r.n,
+           r.buildMs, r.p50, r.p95, r.p99, r.qps, r.memoryBytes / (1024.0 * 1024.0), r.distancesPerQuery,
+           r.recall);
+}
+
+static bool writeCsv(const string &path, const vector<EngineResult> &all, size_t k)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "engine,n,k,build_ms,p50_us,p95_us,p99_us,qps,memory_bytes,distances_per_query,recall\n");
+    for (const EngineResult &r : all)
+        fprintf(f, "%s,%zu,%zu,%.3f,%.3f,%.3f,%.3f,%.1f,%zu,%.2f,%.4f\n", r.engine.c_str(), r.n, k, r.buildMs,
+                r.p50, r.p95, r.p99, r.qps, r.memoryBytes, r.distancesPerQuery, r.recall);
+    fclose(f);
+    return true;
+}
+
+static bool writeJson(const string &path, const vector<EngineResult> &all, size_t k, size_t nq, size_t warmup)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "{\n  \"k\": %zu,\n  \"queries\": %zu,\n  \"warmup\": %zu,\n  \"results\": [\n", k, nq, warmup);
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        const EngineResult &r = all[i];
+        fprintf(f,
+                "    {\"engine\": \"%s\", \"n\": %zu, \"build_ms\": %.3f, \"p50_us\": %.3f, \"p95_us\": %.3f, "
+                "\"p99_us\": %.3f, \"qps\": %.1f, \"memory_bytes\": %zu, \"distances_per_query\": %.2f, "
+                "\"recall\": %.4f}%s\n",
+                r.engine.c_str(), r.n, r.buildMs, r.p50, r.p95, r.p99, r.qps, r.memoryBytes,
+                r.distancesPerQuery, r.recall, i + 1 < all.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return true;
+}
+
+static vector<size_t> parseSizes(const char *text)
+{
+    vector<size_t> sizes;
+    for (const char *p = text; *p;)
+    {
+        char *end;
+        size_t v = strtoull(p, &end, 10);
+        if (end == p) break;
+        if (v > 0) sizes.push_back(v);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return sizes;
+}
+
+int main(int argc, char **argv)
+{
+    vector<size_t> sizes = {1000, 10000, 100000};
+    size_t nq = 500, k = 10, warmup = 50, rerank = 64;
+    string csvPath, jsonPath, datasetPath;
+    bool quantize = false, sparse = false, coarse = false;
+    RowFormat format = RowFormat::U8;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        const char *next = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--sizes" && next) { sizes = parseSizes(next); i++; }
+        else if (arg == "--queries" && next) { nq = strtoull(next, nullptr, 10); i++; }
+        else if (arg == "--k" && next) { k = strtoull(next, nullptr, 10); i++; }
+        else if (arg == "--warmup" && next) { warmup = strtoull(next, nullptr, 10); i++; }
+        else if (arg == "--rerank" && next) { rerank = strtoull(next, nullptr, 10); i++; }
+        else if (arg == "--csv" && next) { csvPath = next; i++; }
+        else if (arg == "--json" && next) { jsonPath = next; i++; }
+        else if (arg == "--dataset" && next) { datasetPath = next; i++; }
+        else if (arg == "--quantize" && next && parseRowFormat(next, format)) { quantize = true; i++; }
+        else if (arg == "--sparse") sparse = true;
+        else if (arg == "--coarse") coarse = true;
+        else { fprintf(stderr, "opcao desconhecida: %s\n", arg.c_str()); return 1; }
+    }
+    if (sizes.empty() || nq == 0 || k == 0) { fprintf(stderr, "--sizes, --queries e --k devem ser > 0\n"); return 1; }
+    sort(sizes.begin(), sizes.end());
+
+    // uma base com o maior N + as consultas; cada N usa o prefixo da base
+    const size_t maxN = sizes.back();
+    FeatureStore generated;
+    MappedIndexFile dataset;
+    if (datasetPath.empty())
+    {
+        SyntheticParams synthetic;
+        synthetic.seed = 11;
+        ThreadPool generator;
+        generateSynthetic(generated, maxN + nq, {}, synthetic, generator);
+    }
+    else if (!dataset.open(datasetPath))
+    {
+        fprintf(stderr, "indice rejeitado: %s\n", dataset.error().c_str());
+        return 1;
+    }
+    const FeatureStore &store = datasetPath.empty() ? generated : dataset.store();
+    if (store.size() < maxN + nq)
+    {
+        fprintf(stderr, "a base tem %u linhas; sao necessarias %zu (maior N + consultas)\n", store.size(), maxN + nq);
+        return 1;
+    }
+    vector<const float *> queries(nq);
+    for (size_t q = 0; q < nq; q++) queries[q] = store.row((uint32_t)(maxN + q));
+
+    printf("consultas=%zu k=%zu warmup=%zu rerank=%zu\n", nq, k, warmup, rerank);
+    printf("%-13s %8s %10s %9s %9s %9s %10s %11s %10s %7s\n", "estrutura", "N", "build ms", "p50 us",
+           "p95 us", "p99 us", "cons/s", "memoria MB", "dist/cons", "recall");
+
+    QuantizedStore qstore(format);
+    if (quantize) qstore = QuantizedStore::encode(store, format);
+    SparseStore sstore(store.dims());
+    if (sparse) sstore = SparseStore::encode(store);
+    CoarsePyramid pyramid;
+    if (coarse) pyramid = CoarsePyramid::build(store);
+
+    vector<EngineResult> all;
+    for (size_t n : sizes)
+    {
+        vector<uint32_t> base(n);
+        for (uint32_t r = 0; r < n; r++) base[r] = r;
+
+        // verdade: varredura linear exata (qui-quadrado)
+        vector<vector<Neighbor>> truth(nq);
+        for (size_t q = 0; q < nq; q++) truth[q] = searchKnn(store, base, queries[q], k);
+
+        auto record = [&](EngineResult res) {
+            res.n = n;
+            printRow(res);
+            all.push_back(res);
+        };
+
+        {
+            EngineResult res{"lista"};
+            res.memoryBytes = base.capacity() * sizeof(uint32_t);
+            runQueries(res, [&](const float *q, size_t &d) { d += n; return searchKnn(store, base, q, k); },
+                       queries, truth, warmup);
+            record(res);
+        }
+        {
+            EngineResult res{"hash"};
+            auto t = chrono::steady_clock::now();
+            SimHashIndex hash(store);
+            hash.build(base);
+            res.buildMs = msSince(t);
+            res.memoryBytes = hash.memoryBytes();
+            runQueries(res, [&](const float *q, size_t &d) {
+                HashSearchResult r = hash.searchReranked(q, (int)k, rerank);
+                d += r.reranked;
+                vector<Neighbor> out(r.top.size());
+                for (size_t i = 0; i < out.size(); i++) out[i] = {r.top[i].first, r.distances[i]};
+                return out;
+            }, queries, truth, warmup);
+            record(res);
+        }
+        {
+            EngineResult res{"quadtree"};
+            auto t = chrono::steady_clock::now();
+            QuadtreeIndex quadtree(store);
+            quadtree.build(base);
+            res.buildMs = msSince(t);
+            res.memoryBytes = quadtree.memoryBytes();
+            runQueries(res, [&](const float *q, size_t &d) {
+                QueryStats stats;
+                vector<Neighbor> hits = quadtree.knn(q, k, &stats);
+                d += stats.distances;
+                return hits;
+            }, queries, truth, warmup);
+            record(res);
+        }
+        for (bool bulk : {false, true})
+        {
+            EngineResult res{bulk ? "mtree-bulk" : "mtree-insert"};
+            auto t = chrono::steady_clock::now();
+            MTree tree(store);
+            if (bulk) tree.bulkLoad(base);
+            else tree.build(base);
+            res.buildMs = msSince(t);
+            res.memoryBytes = tree.memoryBytes();
+            runQueries(res, [&](const float *q, size_t &d) {
+                QueryStats stats;
+                vector<Neighbor> hits = tree.knn(q, k, &stats);
+                d += stats.distances;
+                return hits;
+            }, queries, truth, warmup);
+            record(res);
+        }
+        if (quantize)
+        {
+            // memória = códigos do prefixo (as linhas float só servem ao re-rank)
+            string suffix = string("-") + rowFormatName(format);
+            const size_t codeBytes = (size_t)((double)qstore.memoryBytes() / qstore.size() * n);
+            {
+                EngineResult res{"lista" + suffix};
+                res.memoryBytes = codeBytes + base.capacity() * sizeof(uint32_t);
+                runQueries(res, [&](const float *q, size_t &d) {
+                    QueryStats stats;
+                    vector<Neighbor> hits = searchKnnQuantized(qstore, base, q, k, &store, &stats);
+                    d += stats.distances;
+                    return hits;
+                }, queries, truth, warmup);
+                record(res);
+            }
+            {
+                EngineResult res{"mtree" + suffix};
+                auto t = chrono::steady_clock::now();
+                QuantizedMTree tree(qstore);
+                tree.bulkLoad(base);
+                res.buildMs = msSince(t);
+                res.memoryBytes = codeBytes + tree.memoryBytes();
+                runQueries(res, [&](const float *q, size_t &d) {
+                    QueryStats stats;
+                    vector<Neighbor> hits = knnReranked(tree, qstore, store, q, k, &stats);
+                    d += stats.distances;
+                    return hits;
+                }, queries, truth, warmup);
+                record(res);
+            }
+        }
+        if (sparse)
+        {
+            // memória = parte do store esparso ocupada pelo prefixo
+            const size_t sparseBytes = (size_t)((double)sstore.memoryBytes() / sstore.size() * n);
+            {
+                EngineResult res{"lista-esparsa"};
+                res.memoryBytes = sparseBytes + base.capacity() * sizeof(uint32_t);
+                runQueries(res, [&](const float *q, size_t &d) { d += n; return searchKnnSparse(sstore, base, q, k); },
+                           queries, truth, warmup);
+                record(res);
+            }
+            {
+                EngineResult res{"mtree-esparsa"};
+                auto t = chrono::steady_clock::now();
+                SparseMTree tree(sstore);
+                tree.bulkLoad(base);
+                res.buildMs = msSince(t);
+                res.memoryBytes = sparseBytes + tree.memoryBytes();
+                runQueries(res, [&](const float *q, size_t &d) {
+                    QueryStats stats;
+                    vector<Neighbor> hits = tree.knn(q, k, &stats);
+                    d += stats.distances;
+                    return hits;
+                }, queries, truth, warmup);
+                record(res);
+            }
+        }
+        if (coarse)
+        {
+            // memória = níveis grossos do prefixo; dist/cons só conta as de 512 bins
+            const size_t pyramidBytes = (size_t)((double)pyramid.memoryBytes() / pyramid.size() * n);
+            {
+                EngineResult res{"lista-piramide"};
+                res.memoryBytes = pyramidBytes + base.capacity() * sizeof(uint32_t);
+                runQueries(res, [&](const float *q, size_t &d) {
+                    QueryStats stats;
+                    vector<Neighbor> hits = searchKnnCoarse(store, pyramid, base, q, k, &stats);
+                    d += stats.distances;
+                    return hits;
+                }, queries, truth, warmup);
+                record(res);
+            }
+            {
+                EngineResult res{"mtree-piramide"};
+                auto t = chrono::steady_clock::now();
+                MTree tree(store);
+                tree.bulkLoad(base);
+                res.buildMs = msSince(t);
+                res.memoryBytes = pyramidBytes + tree.memoryBytes();
+                runQueries(res, [&](const float *q, size_t &d) {
+                    QueryStats stats;
+                    vector<Neighbor> hits = tree.knnFiltered(q, k, CoarseFilter<MTree::distance_type>(pyramid, q), &stats);
+                    d += stats.distances;
+                    return hits;
+                }, queries, truth, warmup);
+                record(res);
+            }
+        }
+    }
+
+    if (!csvPath.empty() && !writeCsv(csvPath, all, k))
+        fprintf(stderr, "nao foi possivel gravar %s\n", csvPath.c_str());
+    if (!jsonPath.empty() && !writeJson(jsonPath, all, k, nq, warmup))
+        fprintf(stderr, "nao foi possivel gravar %s\n", jsonPath.c_str());
+    return 0;
+}
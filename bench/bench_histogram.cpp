@@ -0,0 +1,101 @@
+// Compara o histograma rápido (histogram.hpp) com a versão original nas imagens de images/.
+//   g++ -std=c++17 -O2 -o bench_histogram bench/bench_histogram.cpp
+#include "../histogram.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Versão original do main.cpp: multiplica/divide por pixel e um único vector<int>
+static vector<float> legacyComputeRGBHistogram(const ImageRGB8 &img)
+{
+    const int bins = 8;
+    vector<int> hist(bins * bins * bins, 0);
+
+    for (int i = 0; i < img.width * img.height; i++)
+    {
+        unsigned char R = img.data[i * 3 + 0];
+        unsigned char G = img.data[i * 3 + 1];
+        unsigned char B = img.data[i * 3 + 2];
+
+        int rBin = R * bins / 256;
+        int gBin = G * bins / 256;
+        int bBin = B * bins / 256;
+
+        int idx = (rBin * bins + gBin) * bins + bBin;
+        hist[idx]++;
+    }
+
+    float total = static_cast<float>(img.width * img.height);
+    vector<float> norm(hist.size());
+    for (size_t i = 0; i < hist.size(); i++)
+        norm[i] = hist[i] / total;
+
+    return norm;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 100;
+    const int reps = 5;
+
+    vector<ImageRGB8> images;
+    size_t pixels = 0;
+    for (int i = 1; i <= count; i++)
+    {
+        ImageRGB8 img;
+        if (!loadPPM_P6("images/img" + to_string(i) + ".ppm", img))
+            continue;
+        pixels += (size_t)img.width * img.height;
+        images.push_back(move(img));
+    }
+    if (images.empty())
+    {
+        fprintf(stderr, "Nenhuma imagem em images/ (rode a partir da raiz do repositorio).\n");
+        return 1;
+    }
+
+    // mesma saída bit a bit
+    vector<float> fast(kHistSize);
+    size_t mismatches = 0;
+    for (auto &img : images)
+    {
+        vector<float> ref = legacyComputeRGBHistogram(img);
+        computeRGBHistogram(img.data.data(), (size_t)img.width * img.height, fast.data());
+        mismatches += ref != fast;
+    }
+
+    float sink = 0.0f;
+    auto t1 = chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++)
+        for (auto &img : images)
+            sink += legacyComputeRGBHistogram(img)[0];
+    auto t2 = chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++)
+        for (auto &img : images)
+        {
+            computeRGBHistogram(img.data.data(), (size_t)img.width * img.height, fast.data());
+            sink += fast[0];
+        }
+    auto t3 = chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++)
+        for (auto &img : images)
+        {
+            alignas(64) uint32_t sub[4][kHistSize] = {};
+            histogramCountScalar(img.data.data(), (size_t)img.width * img.height, sub);
+            histogramNormalize(sub, (size_t)img.width * img.height, fast.data());
+            sink += fast[0];
+        }
+    auto t4 = chrono::steady_clock::now();
+
+    double legacy = chrono::duration<double>(t2 - t1).count();
+    double current = chrono::duration<double>(t3 - t2).count();
+    double scalar = chrono::duration<double>(t4 - t3).count();
+    double mpix = pixels * (double)reps / 1e6;
+    printf("%zu imagens, %.1f Mpixels por passada (diferencas: %zu)\n", images.size(), pixels / 1e6, mismatches);
+    printf("original: %8.1f Mpixel/s\n", mpix / legacy);
+    printf("rapido:   %8.1f Mpixel/s  (%.2fx)\n", mpix / current, legacy / current);
+    printf("  scalar: %8.1f Mpixel/s  (%.2fx, sem SIMD)\n", mpix / scalar, legacy / scalar);
+    return sink < 0; // evita que o compilador descarte o trabalho
+}
@@ -0,0 +1,104 @@
+// Construção da M-Tree: inserção item a item x bulkLoad, e o custo das
+// consultas k-NN em cada árvore (distâncias calculadas e latência). Roda na
+// base sintética e numa base cheia de linhas repetidas (64 histogramas
+// distintos), onde os empates entre pivôs testam o equilíbrio dos cortes.
+//   g++ -std=c++17 -O2 -pthread -o bench_mtree_build bench/bench_mtree_build.cpp
+//   ./bench_mtree_build [N=100000] [consultas=200] [fanout=16] [threads]
+#include "../feature_store.hpp"
+#include "../search_list.hpp"
+#include "../search_mtree.hpp"
+#include "../synthetic_dataset.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct QueryCost
+{
+    double microsPerQuery;
+    double distancesPerQuery;
+    size_t mismatches; // diferenças para a busca linear (k-NN exato)
+};
+
+static QueryCost measure(const MTree &tree, const FeatureStore &store, const vector<uint32_t> &queries,
+                         size_t k, const vector<vector<Neighbor>> &truth)
+{
+    QueryStats stats;
+    size_t mismatches = 0;
+    auto t1 = chrono::steady_clock::now();
+    for (size_t q = 0; q < queries.size(); q++)
+    {
+        vector<Neighbor> hits = tree.knn(store.row(queries[q]), k, &stats);
+        for (size_t i = 0; i < hits.size() && i < truth[q].size(); i++)
+            if (hits[i].distance != truth[q][i].distance)
+                mismatches++;
+    }
+    auto t2 = chrono::steady_clock::now();
+    return {chrono::duration<double, micro>(t2 - t1).count() / queries.size(),
+            (double)stats.distances / queries.size(), mismatches};
+}
+
+// Constrói a árvore das duas formas e mede as consultas contra a busca linear
+static void runBuilds(const char *label, const FeatureStore &store, const vector<uint32_t> &base,
+                      const vector<uint32_t> &queries, size_t k, const MTreeParams &params, int threads)
+{
+    vector<vector<Neighbor>> truth(queries.size());
+    for (size_t q = 0; q < queries.size(); q++)
+        truth[q] = searchKnn<MTree::distance_type>(store, base, store.row(queries[q]), k);
+
+    printf("\n[%s]\n", label);
+    printf("%-8s %12s %7s %8s %12s %12s %10s\n", "build", "ms", "altura", "nos", "us/consulta", "dist/consulta", "diferencas");
+    {
+        MTree tree(store, params);
+        auto t1 = chrono::steady_clock::now();
+        tree.build(base);
+        auto t2 = chrono::steady_clock::now();
+        QueryCost c = measure(tree, store, queries, k, truth);
+        printf("%-8s %12.1f %7zu %8zu %12.1f %12.1f %10zu\n", "insert",
+               chrono::duration<double, milli>(t2 - t1).count(), tree.height(), tree.nodeCount(),
+               c.microsPerQuery, c.distancesPerQuery, c.mismatches);
+    }
+    {
+        MTree tree(store, params);
+        auto t1 = chrono::steady_clock::now();
+        tree.bulkLoad(base, threads);
+        auto t2 = chrono::steady_clock::now();
+        QueryCost c = measure(tree, store, queries, k, truth);
+        printf("%-8s %12.1f %7zu %8zu %12.1f %12.1f %10zu\n", "bulk",
+               chrono::duration<double, milli>(t2 - t1).count(), tree.height(), tree.nodeCount(),
+               c.microsPerQuery, c.distancesPerQuery, c.mismatches);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+    size_t nq = argc > 2 ? strtoull(argv[2], nullptr, 10) : 200;
+    MTreeParams params;
+    if (argc > 3) params.capacity = strtoull(argv[3], nullptr, 10);
+    int threads = argc > 4 ? atoi(argv[4]) : defaultThreadCount();
+    const size_t k = 10;
+
+    FeatureStore store;
+    SyntheticParams synthetic;
+    synthetic.seed = 7;
+    ThreadPool generator;
+    generateSynthetic(store, n + nq, {}, synthetic, generator);
+    vector<uint32_t> base(n), queries(nq);
+    for (uint32_t r = 0; r < n; r++) base[r] = r;
+    for (uint32_t q = 0; q < nq; q++) queries[q] = (uint32_t)(n + q);
+
+    printf("N=%zu consultas=%zu k=%zu fanout=%zu threads=%d\n", n, nq, k, params.capacity, threads);
+    runBuilds("sintetica", store, base, queries, k, params, threads);
+
+    // mesma quantidade de linhas, cada uma cópia de um dos 64 primeiros histogramas
+    FeatureStore dups;
+    const uint32_t distinct = (uint32_t)min<size_t>(64, n);
+    for (uint32_t r = 0; r < n + nq; r++)
+        dups.add("dup_" + to_string(r), store.row(r < n ? r % distinct : r));
+    runBuilds("repetidas", dups, base, queries, k, params, threads);
+    return 0;
+}
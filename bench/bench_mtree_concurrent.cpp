@@ -0,0 +1,116 @@
+// Estresse do ConcurrentMTree: leitores fazem k-NN enquanto escritores acrescentam
+// linhas ao FeatureStore e inserem/removem linhas na árvore; toda resposta é
+// conferida com a busca linear sobre as linhas do mesmo snapshot. Sai com
+// código 1 se alguma resposta divergir.
+//   g++ -std=c++17 -O2 -pthread -o bench_mtree_concurrent bench/bench_mtree_concurrent.cpp
+//   ./bench_mtree_concurrent [N=20000] [segundos=5] [leitores=4] [escritores=2]
+#include "../feature_store.hpp"
+#include "../search_list.hpp"
+#include "../search_mtree_concurrent.hpp"
+#include "../synthetic_dataset.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000;
+    double seconds = argc > 2 ? atof(argv[2]) : 5.0;
+    int readers = argc > 3 ? atoi(argv[3]) : 4;
+    int writers = argc > 4 ? atoi(argv[4]) : 2;
+    const size_t k = 5, batch = 16;
+
+    // metade das linhas começa no store e na árvore; a outra metade é
+    // acrescentada ao store (que cresce com os leitores ativos) e entra/sai
+    FeatureStore source, store;
+    SyntheticParams synthetic;
+    synthetic.seed = 11;
+    ThreadPool generator;
+    generateSynthetic(source, 2 * n, {}, synthetic, generator);
+    vector<uint32_t> initial(n);
+    for (uint32_t r = 0; r < n; r++) initial[r] = store.add(string(source.id(r)), source.row(r));
+
+    ConcurrentMTree tree(store);
+    tree.bulkLoad(initial);
+
+    atomic<bool> stop{false};
+    atomic<size_t> queries{0}, writes{0}, mismatches{0}, lostRemoves{0};
+
+    // cada linha pertence a um só escritor entre o sorteio e o apply;
+    // poolMutex também serializa store.add (um escritor no store)
+    mutex poolMutex;
+    vector<uint32_t> inside = initial, outside;
+    size_t grown = n;
+    auto take = [](vector<uint32_t> &from, size_t count, mt19937_64 &rng, vector<uint32_t> &to) {
+        for (size_t i = 0; i < count && !from.empty(); i++)
+        {
+            size_t j = rng() % from.size();
+            to.push_back(from[j]);
+            from[j] = from.back();
+            from.pop_back();
+        }
+    };
+
+    vector<thread> threads;
+    for (int w = 0; w < writers; w++)
+        threads.emplace_back([&, w] {
+            mt19937_64 rng(100 + w);
+            while (!stop)
+            {
+                vector<uint32_t> ins, rem;
+                {
+                    lock_guard<mutex> lock(poolMutex);
+                    for (size_t i = 0; i < batch && grown < 2 * n; i++, grown++)
+                        outside.push_back(store.add(string(source.id(grown)), source.row(grown)));
+                    take(outside, batch, rng, ins);
+                    take(inside, batch, rng, rem);
+                }
+                size_t removed = tree.apply(ins, rem);
+                if (removed != rem.size())
+                    lostRemoves += rem.size() - removed;
+                {
+                    lock_guard<mutex> lock(poolMutex);
+                    inside.insert(inside.end(), ins.begin(), ins.end());
+                    outside.insert(outside.end(), rem.begin(), rem.end());
+                }
+                writes += ins.size() + rem.size();
+            }
+        });
+
+    for (int r = 0; r < readers; r++)
+        threads.emplace_back([&, r] {
+            mt19937_64 rng(200 + r);
+            while (!stop)
+            {
+                ConcurrentMTree::Snapshot snap = tree.snapshot();
+                const float *query = store.row((uint32_t)(rng() % store.size()));
+                vector<Neighbor> got = snap->knn(query, k);
+                vector<Neighbor> want = searchKnn<MTree::distance_type>(store, snap->rows(), query, k);
+                bool same = got.size() == want.size();
+                for (size_t i = 0; same && i < got.size(); i++)
+                    same = got[i].row == want[i].row && got[i].distance == want[i].distance;
+                if (!same)
+                    mismatches++;
+                queries++;
+            }
+        });
+
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop = true;
+    for (thread &t : threads)
+        t.join();
+
+    printf("N=%zu leitores=%d escritores=%d | %zu consultas, %zu escritas, %llu versoes, %zu linhas no fim (%u no store)\n",
+           n, readers, writers, queries.load(), writes.load(), (unsigned long long)tree.version(), tree.size(), store.size());
+    printf("respostas divergentes da busca linear: %zu | remocoes nao encontradas: %zu\n",
+           mismatches.load(), lostRemoves.load());
+    return mismatches || lostRemoves ? 1 : 0;
+}
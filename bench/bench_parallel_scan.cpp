@@ -0,0 +1,61 @@
+// Escalonamento da busca linear exata paralela: consultas/s e GB/s varridos
+// de 1 thread até todos os núcleos (resultados conferidos com a busca sequencial).
+//   g++ -std=c++17 -O2 -pthread -o bench_parallel_scan bench/bench_parallel_scan.cpp
+//   ./bench_parallel_scan [N=100000] [consultas=20] [k=10] [threads máx.]
+#include "../feature_store.hpp"
+#include "../search_list.hpp"
+#include "../synthetic_dataset.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+    size_t nq = argc > 2 ? strtoull(argv[2], nullptr, 10) : 20;
+    size_t k = argc > 3 ? strtoull(argv[3], nullptr, 10) : 10;
+    int maxThreads = argc > 4 ? atoi(argv[4]) : defaultThreadCount();
+
+    FeatureStore store;
+    SyntheticParams synthetic;
+    synthetic.seed = 5;
+    ThreadPool generator;
+    generateSynthetic(store, n + nq, {}, synthetic, generator);
+    vector<uint32_t> base(n);
+    for (uint32_t r = 0; r < n; r++) base[r] = r;
+
+    vector<vector<Neighbor>> truth(nq);
+    auto s1 = chrono::steady_clock::now();
+    for (size_t q = 0; q < nq; q++)
+        truth[q] = searchKnn(store, base, store.row((uint32_t)(n + q)), k);
+    double serial = chrono::duration<double>(chrono::steady_clock::now() - s1).count();
+
+    const double gb = (double)n * store.dims() * sizeof(float) * nq / 1e9;
+    printf("N=%zu consultas=%zu k=%zu (%.0f MB de features)\n", n, nq, k,
+           (double)n * store.dims() * sizeof(float) / 1e6);
+    printf("%-10s %10s %9s %9s %s\n", "threads", "cons/s", "GB/s", "speedup", "resultado");
+    printf("%-10s %10.1f %9.2f %9s %s\n", "sequencial", nq / serial, gb / serial, "1.00x", "-");
+
+    vector<int> counts;
+    for (int t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+    counts.push_back(maxThreads);
+
+    for (int threads : counts)
+    {
+        ThreadPool pool(threads);
+        bool same = true;
+        auto t1 = chrono::steady_clock::now();
+        for (size_t q = 0; q < nq; q++)
+        {
+            vector<Neighbor> got = searchKnnParallel(store, base, store.row((uint32_t)(n + q)), k, pool);
+            for (size_t i = 0; i < got.size(); i++)
+                same = same && got[i].row == truth[q][i].row && got[i].distance == truth[q][i].distance;
+        }
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - t1).count();
+        printf("%-10d %10.1f %9.2f %8.2fx %s\n", threads, nq / secs, gb / secs, serial / secs,
+               same ? "ok" : "DIFERENTE");
+    }
+    return 0;
+}
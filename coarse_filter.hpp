@@ -0,0 +1,191 @@
+// coarse_filter.hpp — pirâmide de histogramas grosseiros e filtro por limite inferior
+#pragma once
+#include "feature_store.hpp"
+#include "distance.hpp"
+#include "distance_policy.hpp"
+#include "query_stats.hpp"
+#include "search_mtree.hpp"
+#include "thread_pool.hpp"
+#include "top_k.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - Junto de cada linha guarda o mesmo histograma em grades mais grossas:
+       4x4x4 (64 bins, cada um soma 2x2x2 bins da grade 8x8x8) e 2x2x2
+       (8 bins). 288 B por linha, contra 2 KB da linha float.
+     - O qui-quadrado é conjuntamente convexo e 1-homogêneo, logo subaditivo:
+       (a1+a2 - b1-b2)^2 / (a1+a2 + b1+b2) <= soma dos dois termos. Juntar
+       bins nunca aumenta a distância:
+         chi2_8(p, q) <= chi2_64(p, q) <= chi2_512(p, q)
+     - Filtro em cascata (CoarseFilter): antes do kernel de 512 bins, o
+       candidato é descartado se o limite de 8 bins (uma linha de 32 B) ou,
+       em seguida, o de 64 bins já passa da k-ésima distância atual. Os
+       descartes de cada nível são contados em QueryStats (rejected8 /
+       rejected64); coarseRejectionRate() dá a fração de distâncias exatas
+       evitadas. O resultado é o mesmo top-k da busca sem filtro (margem de
+       0.999 para o arredondamento).
+     - Vale para o qui-quadrado e para a sua raiz (a M-Tree padrão); o limite
+       é comparado no espaço do qui-quadrado.
+
+   API:
+     CoarsePyramid p = CoarsePyramid::build(store);
+     std::vector<Neighbor> v = searchKnnCoarse(store, p, index, query, k);
+     CoarseFilter<SqrtChiSquareDistance> f(p, query);
+     std::vector<Neighbor> w = tree.knnFiltered(query, k, f);   // folhas da M-Tree
+-----------------------------------------------------------------------------*/
+
+static constexpr size_t kCoarseBins64 = 64;   // 4x4x4
+static constexpr size_t kCoarseBins8 = 8;     // 2x2x2
+static constexpr float kCoarseSlack = 0.999f;
+
+// 8x8x8 (índice r<<6 | g<<3 | b) -> 4x4x4 -> 2x2x2
+inline void coarsenHistogram(const float* hist, float* out64, float* out8) {
+    std::memset(out64, 0, kCoarseBins64 * sizeof(float));
+    std::memset(out8, 0, kCoarseBins8 * sizeof(float));
+    for (int r = 0; r < 8; r++)
+        for (int g = 0; g < 8; g++)
+            for (int b = 0; b < 8; b++)
+                out64[(r >> 1) << 4 | (g >> 1) << 2 | (b >> 1)] += hist[r << 6 | g << 3 | b];
+    for (int r = 0; r < 4; r++)
+        for (int g = 0; g < 4; g++)
+            for (int b = 0; b < 4; b++)
+                out8[(r >> 1) << 2 | (g >> 1) << 1 | (b >> 1)] += out64[r << 4 | g << 2 | b];
+}
+
+// chi2 de 8 bins sem desvio (denominador zero só com diferença zero)
+inline float coarseChiSquare8(const float* a, const float* b) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < kCoarseBins8; i++) {
+        float s = a[i] + b[i], d = a[i] - b[i];
+        sum += d * d / (s > 0.0f ? s : 1.0f);
+    }
+    return sum;
+}
+
+// Níveis grossos de todas as linhas, na numeração do FeatureStore; cada nível
+// em um bloco contíguo alinhado (o de 8 bins é lido sozinho na maioria dos descartes)
+class CoarsePyramid {
+public:
+    CoarsePyramid() = default;
+
+    static CoarsePyramid build(const FeatureStore& store, ThreadPool* pool = nullptr) {
+        if (store.dims() != FeatureStore::kDims)
+            throw std::invalid_argument("CoarsePyramid: histogramas 8x8x8 (512 bins)");
+        CoarsePyramid p;
+        p.resize(store.size());
+        auto work = [&](int, size_t b, size_t e) {
+            for (size_t r = b; r < e; r++)
+                coarsenHistogram(store.row((uint32_t)r), p.mutableLevel64(r), p.mutableLevel8(r));
+        };
+        if (pool) pool->parallelFor(0, store.size(), work);
+        else work(0, 0, store.size());
+        return p;
+    }
+
+    // Acrescenta a linha seguinte (hist com 512 bins)
+    uint32_t add(const float* hist) {
+        uint32_t r = rows_;
+        resize(rows_ + 1);
+        coarsenHistogram(hist, mutableLevel64(r), mutableLevel8(r));
+        return r;
+    }
+
+    uint32_t size() const { return rows_; }
+    size_t memoryBytes() const { return (size_t)capacity_ * (kCoarseBins64 + kCoarseBins8) * sizeof(float); }
+
+    const float* level64(uint32_t r) const { return data64_.get() + (size_t)r * kCoarseBins64; }
+    const float* level8(uint32_t r) const { return data8_.get() + (size_t)r * kCoarseBins8; }
+
+private:
+    float* mutableLevel64(size_t r) { return data64_.get() + r * kCoarseBins64; }
+    float* mutableLevel8(size_t r) { return data8_.get() + r * kCoarseBins8; }
+
+    static float* allocLevel(uint32_t rows, size_t bins) {
+        size_t bytes = ((size_t)rows * bins * sizeof(float) + FeatureStore::kAlign - 1) / FeatureStore::kAlign * FeatureStore::kAlign;
+        float* p = static_cast<float*>(std::aligned_alloc(FeatureStore::kAlign, bytes));
+        if (!p) throw std::bad_alloc();
+        return p;
+    }
+
+    void resize(uint32_t rows) {
+        if (rows > capacity_) {
+            uint32_t cap = std::max<uint32_t>(rows, capacity_ ? capacity_ * 2 : 64);
+            std::unique_ptr<float, FreeDeleter> fresh64(allocLevel(cap, kCoarseBins64));
+            std::unique_ptr<float, FreeDeleter> fresh8(allocLevel(cap, kCoarseBins8));
+            if (rows_) {
+                std::memcpy(fresh64.get(), data64_.get(), (size_t)rows_ * kCoarseBins64 * sizeof(float));
+                std::memcpy(fresh8.get(), data8_.get(), (size_t)rows_ * kCoarseBins8 * sizeof(float));
+            }
+            data64_ = std::move(fresh64);
+            data8_ = std::move(fresh8);
+            capacity_ = cap;
+        }
+        rows_ = rows;
+    }
+
+    struct FreeDeleter { void operator()(float* p) const { std::free(p); } };
+
+    uint32_t rows_ = 0, capacity_ = 0;
+    std::unique_ptr<float, FreeDeleter> data64_, data8_;
+};
+
+// Filtro de uma consulta: rejects(row, worst) = algum nível grosso já prova
+// que d(row, consulta) > worst (worst na escala da política Distance)
+template <class Distance>
+class CoarseFilter {
+    static_assert(std::is_same_v<Distance, ChiSquareDistance> || std::is_same_v<Distance, SqrtChiSquareDistance>,
+                  "CoarseFilter: limite só vale para o qui-quadrado e sua raiz");
+
+public:
+    CoarseFilter(const CoarsePyramid& pyramid, const float* query) : pyramid_(pyramid) {
+        coarsenHistogram(query, query64_, query8_);
+    }
+
+    bool rejects(uint32_t row, float worst, QueryStats* stats) const {
+        if (worst == std::numeric_limits<float>::infinity()) return false;   // top-k ainda incompleto
+        const float limit = std::is_same_v<Distance, SqrtChiSquareDistance> ? worst * worst : worst;
+        if (coarseChiSquare8(pyramid_.level8(row), query8_) * kCoarseSlack > limit) {
+            statAdd(stats, &QueryStats::rejected8);
+            return true;
+        }
+        if (chiSquareDist(pyramid_.level64(row), query64_, kCoarseBins64) * kCoarseSlack > limit) {
+            statAdd(stats, &QueryStats::rejected64);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    const CoarsePyramid& pyramid_;
+    alignas(64) float query64_[kCoarseBins64];
+    alignas(32) float query8_[kCoarseBins8];
+};
+
+// k-NN na lista com a cascata 8 -> 64 -> 512 bins; mesmo resultado de searchKnn
+template <class Distance = ChiSquareDistance>
+inline std::vector<Neighbor> searchKnnCoarse(const FeatureStore& store, const CoarsePyramid& pyramid,
+                                             const std::vector<uint32_t>& index, const float* query, size_t k,
+                                             QueryStats* stats = nullptr) {
+    QueryTimer timer(stats, QueryPhase::Total);
+    BoundedTopK<float> best(k);
+    if (k == 0) return best.sorted();
+    CoarseFilter<Distance> filter(pyramid, query);
+    size_t exact = 0;
+    for (uint32_t row : index) {
+        if (filter.rejects(row, best.worst(), stats)) continue;
+        best.push(row, Distance::eval(store.row(row), query, store.dims()));
+        exact++;
+    }
+    statAdd(stats, &QueryStats::distances, exact);
+    return best.sorted();
+}
@@ -0,0 +1,182 @@
+// distance.hpp — distância qui-quadrado compartilhada por todas as estruturas
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PAA_X86_SIMD 1
+#endif
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - chi2(a, b) = soma_i (a_i - b_i)^2 / (a_i + b_i), ignorando bins com
+       a_i + b_i == 0.
+     - Kernels SSE / AVX2 / AVX-512 tratam denominador zero com máscara
+       (sem desvio por bin); o scalar é o fallback.
+     - O kernel é escolhido uma única vez em tempo de execução conforme a CPU.
+
+   API:
+     float chiSquareDist(const float* a, const float* b, size_t n);
+     float chiSquareDist(const std::vector<float>& a, const std::vector<float>& b);
+-----------------------------------------------------------------------------*/
+
+enum class DistanceIsa { Scalar, SSE, AVX2, AVX512 };
+
+inline const char* distanceIsaName(DistanceIsa isa) {
+    switch (isa) {
+        case DistanceIsa::SSE:    return "sse";
+        case DistanceIsa::AVX2:   return "avx2";
+        case DistanceIsa::AVX512: return "avx512";
+        default:                  return "scalar";
+    }
+}
+
+inline float chiSquareScalar(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        float denom = a[i] + b[i];
+        if (denom != 0.0f) {
+            float diff = a[i] - b[i];
+            sum += (diff * diff) / denom;
+        }
+    }
+    return sum;
+}
+
+#ifdef PAA_X86_SIMD
+
+__attribute__((target("sse2")))
+inline float chiSquareSSE(const float* a, const float* b, size_t n) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.0f);
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a0 = _mm_loadu_ps(a + i),     b0 = _mm_loadu_ps(b + i);
+        __m128 a1 = _mm_loadu_ps(a + i + 4), b1 = _mm_loadu_ps(b + i + 4);
+        __m128 d0 = _mm_sub_ps(a0, b0), s0 = _mm_add_ps(a0, b0);
+        __m128 d1 = _mm_sub_ps(a1, b1), s1 = _mm_add_ps(a1, b1);
+        // denominador zero vira 1 e o termo é zerado pela máscara
+        __m128 m0 = _mm_cmpneq_ps(s0, zero), m1 = _mm_cmpneq_ps(s1, zero);
+        s0 = _mm_or_ps(_mm_and_ps(m0, s0), _mm_andnot_ps(m0, one));
+        s1 = _mm_or_ps(_mm_and_ps(m1, s1), _mm_andnot_ps(m1, one));
+        acc0 = _mm_add_ps(acc0, _mm_and_ps(m0, _mm_div_ps(_mm_mul_ps(d0, d0), s0)));
+        acc1 = _mm_add_ps(acc1, _mm_and_ps(m1, _mm_div_ps(_mm_mul_ps(d1, d1), s1)));
+    }
+    __m128 acc = _mm_add_ps(acc0, acc1);
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 0x55));
+    return _mm_cvtss_f32(acc) + chiSquareScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline float chiSquareAVX2(const float* a, const float* b, size_t n) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one  = _mm256_set1_ps(1.0f);
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a0 = _mm256_loadu_ps(a + i),     b0 = _mm256_loadu_ps(b + i);
+        __m256 a1 = _mm256_loadu_ps(a + i + 8), b1 = _mm256_loadu_ps(b + i + 8);
+        __m256 d0 = _mm256_sub_ps(a0, b0), s0 = _mm256_add_ps(a0, b0);
+        __m256 d1 = _mm256_sub_ps(a1, b1), s1 = _mm256_add_ps(a1, b1);
+        __m256 m0 = _mm256_cmp_ps(s0, zero, _CMP_NEQ_OQ);
+        __m256 m1 = _mm256_cmp_ps(s1, zero, _CMP_NEQ_OQ);
+        s0 = _mm256_blendv_ps(one, s0, m0);
+        s1 = _mm256_blendv_ps(one, s1, m1);
+        acc0 = _mm256_add_ps(acc0, _mm256_and_ps(m0, _mm256_div_ps(_mm256_mul_ps(d0, d0), s0)));
+        acc1 = _mm256_add_ps(acc1, _mm256_and_ps(m1, _mm256_div_ps(_mm256_mul_ps(d1, d1), s1)));
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 0x55));
+    return _mm_cvtss_f32(lo) + chiSquareScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline float chiSquareAVX512(const float* a, const float* b, size_t n) {
+    const __m512 zero = _mm512_setzero_ps();
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 a0 = _mm512_loadu_ps(a + i),      b0 = _mm512_loadu_ps(b + i);
+        __m512 a1 = _mm512_loadu_ps(a + i + 16), b1 = _mm512_loadu_ps(b + i + 16);
+        __m512 d0 = _mm512_sub_ps(a0, b0), s0 = _mm512_add_ps(a0, b0);
+        __m512 d1 = _mm512_sub_ps(a1, b1), s1 = _mm512_add_ps(a1, b1);
+        __mmask16 m0 = _mm512_cmp_ps_mask(s0, zero, _CMP_NEQ_OQ);
+        __mmask16 m1 = _mm512_cmp_ps_mask(s1, zero, _CMP_NEQ_OQ);
+        acc0 = _mm512_mask_add_ps(acc0, m0, acc0, _mm512_maskz_div_ps(m0, _mm512_mul_ps(d0, d0), s0));
+        acc1 = _mm512_mask_add_ps(acc1, m1, acc1, _mm512_maskz_div_ps(m1, _mm512_mul_ps(d1, d1), s1));
+    }
+    // cauda com loads mascarados (bins fora do intervalo contam como zero)
+    for (; i < n; i += 16) {
+        size_t rest = n - i;
+        __mmask16 live = rest >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << rest) - 1);
+        __m512 a0 = _mm512_maskz_loadu_ps(live, a + i), b0 = _mm512_maskz_loadu_ps(live, b + i);
+        __m512 d0 = _mm512_sub_ps(a0, b0), s0 = _mm512_add_ps(a0, b0);
+        __mmask16 m0 = _mm512_cmp_ps_mask(s0, zero, _CMP_NEQ_OQ);
+        acc0 = _mm512_mask_add_ps(acc0, m0, acc0, _mm512_maskz_div_ps(m0, _mm512_mul_ps(d0, d0), s0));
+    }
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, _mm512_add_ps(acc0, acc1));
+    float sum = 0.0f;
+    for (int k = 0; k < 16; k++) sum += lanes[k];
+    return sum;
+}
+
+#endif // PAA_X86_SIMD
+
+using ChiSquareFn = float (*)(const float*, const float*, size_t);
+
+// Kernel de um ISA específico (útil para benchmark); cai no scalar se indisponível
+inline ChiSquareFn chiSquareKernel(DistanceIsa isa) {
+#ifdef PAA_X86_SIMD
+    switch (isa) {
+        case DistanceIsa::SSE:    return chiSquareSSE;
+        case DistanceIsa::AVX2:   return chiSquareAVX2;
+        case DistanceIsa::AVX512: return chiSquareAVX512;
+        default: break;
+    }
+#else
+    (void)isa;
+#endif
+    return chiSquareScalar;
+}
+
+inline bool distanceIsaSupported(DistanceIsa isa) {
+#ifdef PAA_X86_SIMD
+    __builtin_cpu_init();
+    switch (isa) {
+        case DistanceIsa::SSE:    return __builtin_cpu_supports("sse2");
+        case DistanceIsa::AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case DistanceIsa::AVX512: return __builtin_cpu_supports("avx512f");
+        default:                  return true;
+    }
+#else
+    return isa == DistanceIsa::Scalar;
+#endif
+}
+
+// Melhor ISA disponível na máquina atual
+inline DistanceIsa detectDistanceIsa() {
+    if (distanceIsaSupported(DistanceIsa::AVX512)) return DistanceIsa::AVX512;
+    if (distanceIsaSupported(DistanceIsa::AVX2))   return DistanceIsa::AVX2;
+    if (distanceIsaSupported(DistanceIsa::SSE))    return DistanceIsa::SSE;
+    return DistanceIsa::Scalar;
+}
+
+inline ChiSquareFn chiSquareDispatch() {
+    static const ChiSquareFn fn = chiSquareKernel(detectDistanceIsa());
+    return fn;
+}
+
+// Distância qui-quadrado entre histogramas
+inline float chiSquareDist(const float* a, const float* b, size_t n) {
+    return chiSquareDispatch()(a, b, n);
+}
+
+inline float chiSquareDist(const std::vector<float>& a, const std::vector<float>& b) {
+    return chiSquareDispatch()(a.data(), b.data(), a.size());
+}
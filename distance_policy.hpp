@@ -0,0 +1,225 @@
+// distance_policy.hpp — políticas de distância para as estruturas de busca
+#pragma once
+#include "distance.hpp"
+#include <cmath>
+#include <cstddef>
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - Cada política é um tipo com membros estáticos, usado como parâmetro de
+       template pelas estruturas (lista, Quadtree, M-Tree, re-rank do Hash):
+         is_metric            — vale a desigualdade triangular? As podas
+                                métricas da M-Tree só são compiladas se sim.
+         eval(a, b, n)        — distância (kernel SIMD escolhido uma vez)
+         kernel(isa)          — kernel de um ISA específico (benchmark)
+         pointLowerBound(d)   — limite inferior da distância entre dois
+                                histogramas normalizados cujos pontos 2D da
+                                Quadtree (R e G médios) diferem d em um eixo
+     - ChiSquareDistance      — qui-quadrado (não é métrica)
+       SqrtChiSquareDistance  — raiz do qui-quadrado: métrica e com a mesma
+                                ordenação do qui-quadrado
+       L1Distance, L2Distance — métricas
+       HellingerDistance      — sqrt(soma (sqrt a - sqrt b)^2): métrica
+
+   Limites da Quadtree (c_i = r_i/8 em [0, 7/8], soma p = soma q = 1, logo
+   d = soma (c_i - 7/16)(p_i - q_i)):
+     L1 >= d * 16/7;  L2 >= d / sqrt(42);  chi2 >= d^2 * 128/49 (Cauchy-Schwarz);
+     Hellinger >= d * 8/7  (|p - q| = |sqrt p - sqrt q|(sqrt p + sqrt q)).
+   A margem de 0.999 cobre o arredondamento.
+-----------------------------------------------------------------------------*/
+
+inline float l1Scalar(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) sum += std::fabs(a[i] - b[i]);
+    return sum;
+}
+
+inline float l2SquaredScalar(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) { float d = a[i] - b[i]; sum += d * d; }
+    return sum;
+}
+
+// soma (sqrt a - sqrt b)^2 (Hellinger ao quadrado, sem o fator 1/2)
+inline float hellingerSquaredScalar(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) { float d = std::sqrt(a[i]) - std::sqrt(b[i]); sum += d * d; }
+    return sum;
+}
+
+#ifdef PAA_X86_SIMD
+
+__attribute__((target("avx2,fma")))
+inline float paaHsum256(__m256 acc) {
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 0x55));
+    return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx512f")))
+inline float paaHsum512(__m512 acc) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, acc);
+    float sum = 0.0f;
+    for (int k = 0; k < 16; k++) sum += lanes[k];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+inline float l1AVX2(const float* a, const float* b, size_t n) {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        acc = _mm256_add_ps(acc, _mm256_and_ps(absMask, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i))));
+    return paaHsum256(acc) + l1Scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline float l2SquaredAVX2(const float* a, const float* b, size_t n) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc = _mm256_fmadd_ps(d, d, acc);
+    }
+    return paaHsum256(acc) + l2SquaredScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline float hellingerSquaredAVX2(const float* a, const float* b, size_t n) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_sqrt_ps(_mm256_loadu_ps(a + i)), _mm256_sqrt_ps(_mm256_loadu_ps(b + i)));
+        acc = _mm256_fmadd_ps(d, d, acc);
+    }
+    return paaHsum256(acc) + hellingerSquaredScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline float l1AVX512(const float* a, const float* b, size_t n) {
+    __m512 acc = _mm512_setzero_ps();
+    for (size_t i = 0; i < n; i += 16) {
+        size_t rest = n - i;
+        __mmask16 live = rest >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << rest) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(live, a + i), _mm512_maskz_loadu_ps(live, b + i));
+        acc = _mm512_add_ps(acc, _mm512_abs_ps(d));
+    }
+    return paaHsum512(acc);
+}
+
+__attribute__((target("avx512f")))
+inline float l2SquaredAVX512(const float* a, const float* b, size_t n) {
+    __m512 acc = _mm512_setzero_ps();
+    for (size_t i = 0; i < n; i += 16) {
+        size_t rest = n - i;
+        __mmask16 live = rest >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << rest) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(live, a + i), _mm512_maskz_loadu_ps(live, b + i));
+        acc = _mm512_fmadd_ps(d, d, acc);
+    }
+    return paaHsum512(acc);
+}
+
+__attribute__((target("avx512f")))
+inline float hellingerSquaredAVX512(const float* a, const float* b, size_t n) {
+    __m512 acc = _mm512_setzero_ps();
+    for (size_t i = 0; i < n; i += 16) {
+        size_t rest = n - i;
+        __mmask16 live = rest >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << rest) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_sqrt_ps(live, _mm512_maskz_loadu_ps(live, a + i)),
+                                 _mm512_maskz_sqrt_ps(live, _mm512_maskz_loadu_ps(live, b + i)));
+        acc = _mm512_fmadd_ps(d, d, acc);
+    }
+    return paaHsum512(acc);
+}
+
+#endif // PAA_X86_SIMD
+
+// Kernel do ISA pedido (cai no scalar se não houver versão SIMD para ele)
+inline ChiSquareFn distanceKernel(DistanceIsa isa, ChiSquareFn scalar, ChiSquareFn avx2, ChiSquareFn avx512) {
+    if (isa == DistanceIsa::AVX512 && avx512) return avx512;
+    if ((isa == DistanceIsa::AVX512 || isa == DistanceIsa::AVX2) && avx2) return avx2;
+    return scalar;
+}
+
+struct ChiSquareDistance {
+    static constexpr bool is_metric = false;
+    static constexpr const char* name = "chi2";
+    static ChiSquareFn kernel(DistanceIsa isa) { return chiSquareKernel(isa); }
+    static float eval(const float* a, const float* b, size_t n) { return chiSquareDist(a, b, n); }
+    static float pointLowerBound(float d) { return d * d * (128.0f / 49.0f) * 0.999f; }
+};
+
+struct SqrtChiSquareDistance {
+    static constexpr bool is_metric = true;
+    static constexpr const char* name = "sqrt-chi2";
+    static ChiSquareFn kernel(DistanceIsa isa) { return chiSquareKernel(isa); } // antes da raiz
+    static float eval(const float* a, const float* b, size_t n) { return std::sqrt(chiSquareDist(a, b, n)); }
+    static float pointLowerBound(float d) { return d * 1.6162176f * 0.999f; }  // sqrt(128/49)
+};
+
+#ifdef PAA_X86_SIMD
+#define PAA_DISTANCE_KERNELS(base) base##Scalar, base##AVX2, base##AVX512
+#else
+#define PAA_DISTANCE_KERNELS(base) base##Scalar, nullptr, nullptr
+#endif
+
+struct L1Distance {
+    static constexpr bool is_metric = true;
+    static constexpr const char* name = "l1";
+    static ChiSquareFn kernel(DistanceIsa isa) { return distanceKernel(isa, PAA_DISTANCE_KERNELS(l1)); }
+    static float eval(const float* a, const float* b, size_t n) {
+        static const ChiSquareFn fn = kernel(detectDistanceIsa());
+        return fn(a, b, n);
+    }
+    static float pointLowerBound(float d) { return d * (16.0f / 7.0f) * 0.999f; }
+};
+
+struct L2Distance {
+    static constexpr bool is_metric = true;
+    static constexpr const char* name = "l2";
+    static ChiSquareFn kernel(DistanceIsa isa) { return distanceKernel(isa, PAA_DISTANCE_KERNELS(l2Squared)); } // ao quadrado
+    static float eval(const float* a, const float* b, size_t n) {
+        static const ChiSquareFn fn = kernel(detectDistanceIsa());
+        return std::sqrt(fn(a, b, n));
+    }
+    static float pointLowerBound(float d) { return d * 0.15430335f * 0.999f; }  // 1/sqrt(42)
+};
+
+struct HellingerDistance {
+    static constexpr bool is_metric = true;
+    static constexpr const char* name = "hellinger";
+    static ChiSquareFn kernel(DistanceIsa isa) { return distanceKernel(isa, PAA_DISTANCE_KERNELS(hellingerSquared)); } // ao quadrado
+    static float eval(const float* a, const float* b, size_t n) {
+        static const ChiSquareFn fn = kernel(detectDistanceIsa());
+        return std::sqrt(fn(a, b, n));
+    }
+    static float pointLowerBound(float d) { return d * (8.0f / 7.0f) * 0.999f; }
+};
+
+#undef PAA_DISTANCE_KERNELS
+
+// Limites inferiores da M-Tree pela desigualdade triangular. Para distâncias
+// que não são métricas viram 0 em tempo de compilação (nada é podado).
+
+// d(q, x) para x na subárvore de um pivô a distância dPivot com raio radius
+template <class Distance>
+inline float subtreeLowerBound(float dPivot, float radius) {
+    if constexpr (Distance::is_metric) return dPivot > radius ? dPivot - radius : 0.0f;
+    else return 0.0f;
+}
+
+// d(q, x) para x na subárvore de uma entrada, sem calcular d(q, entrada):
+// |d(q, pai) - d(entrada, pai)| - raio. dParent < 0 = sem pai (raiz).
+template <class Distance>
+inline float parentLowerBound(float dParent, float entryParentDist, float radius) {
+    if constexpr (Distance::is_metric) {
+        if (dParent < 0.0f) return 0.0f;
+        float lb = std::fabs(dParent - entryParentDist) - radius;
+        return lb > 0.0f ? lb : 0.0f;
+    } else {
+        return 0.0f;
+    }
+}
@@ -0,0 +1,273 @@
+// feature_store.hpp — todos os histogramas em blocos estáveis de linhas contíguas
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - Guarda N histogramas em linhas de dims floats, alinhadas a 64 bytes
+       (cada linha de 512 floats ocupa 2 KB e começa em fronteira de cache line),
+       em blocos de kChunkRows linhas contíguas. Crescer só acrescenta blocos:
+       uma linha nunca muda de endereço.
+     - Cada imagem é identificada pelo número da linha (uint32_t); o id textual
+       é internado uma única vez em blocos de caracteres que também não se movem.
+     - As estruturas de busca guardam apenas números de linha, nunca cópias.
+     - Um escritor (add/reserve) e qualquer número de leitores (row, id, size)
+       podem rodar ao mesmo tempo: o diretório de blocos é publicado com
+       release e lido com acquire (diretórios antigos ficam vivos até o fim
+       do store), e size() só cresce depois que a linha e o id estão escritos.
+       find() usa uma trava; sobrescrever uma linha já lida por alguém
+       (add com id repetido) continua exigindo sincronização externa.
+     - FeatureStore::view() expõe dados externos (ex.: arquivo de índice mapeado)
+       sem copiar; nesse modo o store é somente leitura.
+
+   API:
+     uint32_t add(const std::string& id, const float* hist = nullptr);
+     const float* row(uint32_t r) const;
+     std::string_view id(uint32_t r) const;
+     uint32_t find(const std::string& id) const;   // kNoRow se não existir
+-----------------------------------------------------------------------------*/
+
+// Linha inexistente / resultado vazio
+static constexpr uint32_t kNoRow = std::numeric_limits<uint32_t>::max();
+
+class FeatureStore {
+public:
+    static constexpr size_t kDims = 512;   // 8x8x8 bins RGB
+    static constexpr size_t kAlign = 64;
+    static constexpr uint32_t kChunkShift = 10;             // 1024 linhas por bloco (2 MB com 512 bins)
+    static constexpr uint32_t kChunkRows = 1u << kChunkShift;
+
+    explicit FeatureStore(size_t dims = kDims) : dims_(dims) {}
+
+    ~FeatureStore() { release(); }
+
+    // Store somente leitura sobre memória de terceiros (que deve sobreviver ao store):
+    // features N x dims, idOffsets com N+1 entradas e idChars com os ids concatenados.
+    // data nulo = só ids e size() (ex.: gravar um índice cujas linhas são geradas
+    // em blocos); row() não pode ser usado.
+    static FeatureStore view(const float* data, uint32_t rows, size_t dims,
+                             const uint32_t* idOffsets, const char* idChars) {
+        FeatureStore s(dims);
+        s.external_ = true;
+        s.extIdOffsets_ = idOffsets;
+        s.extIdChars_ = idChars;
+        const size_t chunks = data ? ((size_t)rows + kChunkRows - 1) / kChunkRows : 0;
+        Chunk* dir = s.growDirectory(chunks);
+        for (size_t c = 0; c < chunks; c++)
+            dir[c] = {const_cast<float*>(data) + c * kChunkRows * dims, nullptr};
+        s.chunkCount_ = chunks;
+        s.capacity_ = rows;
+        s.rows_.store(rows, std::memory_order_release);
+        return s;
+    }
+
+    FeatureStore(const FeatureStore&) = delete;
+    FeatureStore& operator=(const FeatureStore&) = delete;
+
+    FeatureStore(FeatureStore&& o) noexcept { *this = std::move(o); }
+    // Mover não é concorrente: ninguém pode estar lendo nenhum dos dois
+    FeatureStore& operator=(FeatureStore&& o) noexcept {
+        if (this != &o) {
+            release();
+            dims_ = o.dims_;
+            rows_.store(o.rows_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            capacity_ = o.capacity_;
+            dir_.store(o.dir_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            dirs_ = std::move(o.dirs_);
+            chunkCount_ = o.chunkCount_; dirCapacity_ = o.dirCapacity_;
+            external_ = o.external_; extIdOffsets_ = o.extIdOffsets_; extIdChars_ = o.extIdChars_;
+            idBlocks_ = std::move(o.idBlocks_);
+            idBlockUsed_ = o.idBlockUsed_; idBlockSize_ = o.idBlockSize_;
+            rowById_ = std::move(o.rowById_);
+            o.rows_.store(0, std::memory_order_relaxed);
+            o.dir_.store(nullptr, std::memory_order_relaxed);
+            o.capacity_ = 0; o.chunkCount_ = o.dirCapacity_ = 0; o.external_ = false;
+            o.idBlockUsed_ = o.idBlockSize_ = 0;
+        }
+        return *this;
+    }
+
+    uint32_t size() const { return rows_.load(std::memory_order_acquire); }
+    size_t dims() const { return dims_; }
+    bool empty() const { return size() == 0; }
+    bool readOnly() const { return external_; }
+
+    // Bytes ocupados pelas linhas (sem os ids)
+    size_t featureBytes() const { return (size_t)capacity_ * dims_ * sizeof(float); }
+
+    // Garante espaço para rows linhas (blocos novos; as linhas existentes não se movem)
+    void reserve(size_t rows) {
+        if (rows <= capacity_) return;
+        if (external_) throw std::logic_error("FeatureStore somente leitura");
+        if (rows >= kNoRow) throw std::length_error("FeatureStore: linhas demais");
+        const size_t chunks = (rows + kChunkRows - 1) / kChunkRows;
+        Chunk* dir = chunks > dirCapacity_ ? growDirectory(chunks) : dir_.load(std::memory_order_relaxed);
+        for (size_t c = chunkCount_; c < chunks; c++) {
+            float* data = static_cast<float*>(std::aligned_alloc(kAlign, alignedChunkBytes()));
+            if (!data) throw std::bad_alloc();
+            dir[c] = {data, new std::string_view[kChunkRows]};
+            chunkCount_ = c + 1;
+        }
+        capacity_ = (uint32_t)(chunks * kChunkRows);
+    }
+
+    // Adiciona (ou sobrescreve, se o id já existir) uma linha; hist nulo = zeros
+    uint32_t add(const std::string& id, const float* hist = nullptr) {
+        if (external_) throw std::logic_error("FeatureStore somente leitura");
+        uint32_t r;
+        {
+            std::lock_guard<std::mutex> lock(idMutex_);
+            auto found = rowById_.find(id);
+            r = found != rowById_.end() ? found->second : kNoRow;
+        }
+        const bool fresh = r == kNoRow;
+        if (fresh) {
+            r = rows_.load(std::memory_order_relaxed);
+            if (r == capacity_) reserve((size_t)r + 1);
+            const Chunk& c = dir_.load(std::memory_order_relaxed)[r >> kChunkShift];
+            c.ids[r & (kChunkRows - 1)] = internId(id);
+        }
+        if (hist) std::memcpy(row(r), hist, dims_ * sizeof(float));
+        else      std::memset(row(r), 0, dims_ * sizeof(float));
+        if (fresh) {
+            {
+                std::lock_guard<std::mutex> lock(idMutex_);
+                rowById_.emplace(id, r);
+            }
+            rows_.store(r + 1, std::memory_order_release);   // publica linha e id
+        }
+        return r;
+    }
+
+    uint32_t add(const std::string& id, const std::vector<float>& hist) {
+        return add(id, hist.data());
+    }
+
+    float* row(uint32_t r) {
+        return dir_.load(std::memory_order_acquire)[r >> kChunkShift].rows + (size_t)(r & (kChunkRows - 1)) * dims_;
+    }
+    const float* row(uint32_t r) const {
+        return dir_.load(std::memory_order_acquire)[r >> kChunkShift].rows + (size_t)(r & (kChunkRows - 1)) * dims_;
+    }
+
+    std::string_view id(uint32_t r) const {
+        if (external_)
+            return std::string_view(extIdChars_ + extIdOffsets_[r], extIdOffsets_[r + 1] - extIdOffsets_[r]);
+        return dir_.load(std::memory_order_acquire)[r >> kChunkShift].ids[r & (kChunkRows - 1)];
+    }
+
+    uint32_t find(const std::string& id) const {
+        if (external_) { // sem tabela de ids no modo view: busca linear
+            for (uint32_t r = 0; r < size(); r++)
+                if (this->id(r) == id) return r;
+            return kNoRow;
+        }
+        std::lock_guard<std::mutex> lock(idMutex_);
+        auto found = rowById_.find(id);
+        return found == rowById_.end() ? kNoRow : found->second;
+    }
+
+    // Linhas [first, first + n) que estão no mesmo bloco contíguo que first
+    size_t contiguousRows(uint32_t first) const {
+        return kChunkRows - (first & (kChunkRows - 1));
+    }
+
+    // Ids no layout do arquivo de índice (para serialização): N+1 offsets e os caracteres
+    void exportIds(std::vector<uint32_t>& offsets, std::vector<char>& chars) const {
+        const uint32_t n = size();
+        offsets.assign(1, 0);
+        offsets.reserve((size_t)n + 1);
+        chars.clear();
+        for (uint32_t r = 0; r < n; r++) {
+            std::string_view s = id(r);
+            chars.insert(chars.end(), s.begin(), s.end());
+            offsets.push_back((uint32_t)chars.size());
+        }
+    }
+
+    // Todas as linhas [0, size) — conveniente para construir índices
+    std::vector<uint32_t> allRows() const {
+        std::vector<uint32_t> rows(size());
+        for (uint32_t r = 0; r < rows.size(); r++) rows[r] = r;
+        return rows;
+    }
+
+private:
+    // Bloco de linhas e os ids delas (ids nulo no modo view)
+    struct Chunk {
+        float* rows;
+        std::string_view* ids;
+    };
+
+    size_t alignedChunkBytes() const {
+        return (kChunkRows * dims_ * sizeof(float) + kAlign - 1) / kAlign * kAlign;
+    }
+
+    // Diretório novo com os blocos atuais; o antigo fica vivo (leitores em voo)
+    Chunk* growDirectory(size_t chunks) {
+        size_t cap = dirCapacity_ ? dirCapacity_ : 16;
+        while (cap < chunks) cap *= 2;
+        std::unique_ptr<Chunk[]> fresh(new Chunk[cap]());
+        Chunk* old = dir_.load(std::memory_order_relaxed);
+        if (old) std::copy(old, old + chunkCount_, fresh.get());
+        Chunk* out = fresh.get();
+        dirs_.push_back(std::move(fresh));
+        dirCapacity_ = cap;
+        dir_.store(out, std::memory_order_release);
+        return out;
+    }
+
+    // Cópia estável do id (os blocos de caracteres nunca realocam)
+    std::string_view internId(const std::string& id) {
+        if (id.size() > idBlockSize_ - idBlockUsed_) {
+            idBlockSize_ = std::max<size_t>(64 * 1024, id.size());
+            idBlocks_.emplace_back(new char[idBlockSize_]);
+            idBlockUsed_ = 0;
+        }
+        char* dst = idBlocks_.back().get() + idBlockUsed_;
+        std::memcpy(dst, id.data(), id.size());
+        idBlockUsed_ += id.size();
+        return std::string_view(dst, id.size());
+    }
+
+    void release() {
+        Chunk* dir = dir_.load(std::memory_order_relaxed);
+        if (dir && !external_)
+            for (size_t c = 0; c < chunkCount_; c++) {
+                std::free(dir[c].rows);
+                delete[] dir[c].ids;
+            }
+        dirs_.clear();
+        idBlocks_.clear();
+        dir_.store(nullptr, std::memory_order_relaxed);
+        chunkCount_ = dirCapacity_ = 0;
+    }
+
+    size_t dims_;
+    std::atomic<uint32_t> rows_{0};
+    uint32_t capacity_ = 0;
+    std::atomic<Chunk*> dir_{nullptr};
+    std::vector<std::unique_ptr<Chunk[]>> dirs_;   // atual + anteriores
+    size_t chunkCount_ = 0, dirCapacity_ = 0;
+    bool external_ = false;
+    const uint32_t* extIdOffsets_ = nullptr;
+    const char* extIdChars_ = nullptr;
+
+    std::vector<std::unique_ptr<char[]>> idBlocks_;
+    size_t idBlockUsed_ = 0, idBlockSize_ = 0;
+    mutable std::mutex idMutex_;                   // só rowById_ (add x find)
+    std::unordered_map<std::string, uint32_t> rowById_;
+};
@@ -0,0 +1,146 @@
+#pragma once
+#include "ppm_loader.hpp"
+#include "distance.hpp" // PAA_X86_SIMD / immintrin.h
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* -----------------------------------------------------------------------------
+   Histograma RGB 8x8x8 (512 bins):
+     - bin de cada canal = v >> 5 (igual a v * 8 / 256), índice = r<<6 | g<<3 | b
+     - 4 sub-histogramas intercalados (pixel i vai para o sub-histograma i % 4),
+       somados no final: sequências da mesma cor não serializam no mesmo contador
+     - com SSSE3, 16 pixels (48 bytes RGB) são carregados e separados por pshufb
+       e os 16 índices são calculados em SIMD
+     - normalização escrita direto na linha "out" (sem vetor temporário)
+-----------------------------------------------------------------------------*/
+
+static constexpr int kHistBins = 8;
+static constexpr int kHistSize = kHistBins * kHistBins * kHistBins;
+
+inline int rgbBinIndex(unsigned char R, unsigned char G, unsigned char B)
+{
+  return ((R >> 5) << 6) | ((G >> 5) << 3) | (B >> 5);
+}
+
+inline void histogramNormalize(const uint32_t (*sub)[kHistSize], size_t pixels, float *out)
+{
+  float total = static_cast<float>(pixels);
+  for (int i = 0; i < kHistSize; i++)
+  {
+    uint32_t c = sub[0][i] + sub[1][i] + sub[2][i] + sub[3][i];
+    out[i] = pixels ? c / total : 0.0f;
+  }
+}
+
+inline void histogramCountScalar(const unsigned char *rgb, size_t pixels, uint32_t (*sub)[kHistSize])
+{
+  size_t i = 0;
+  for (; i + 4 <= pixels; i += 4, rgb += 12)
+  {
+    sub[0][rgbBinIndex(rgb[0], rgb[1], rgb[2])]++;
+    sub[1][rgbBinIndex(rgb[3], rgb[4], rgb[5])]++;
+    sub[2][rgbBinIndex(rgb[6], rgb[7], rgb[8])]++;
+    sub[3][rgbBinIndex(rgb[9], rgb[10], rgb[11])]++;
+  }
+  for (; i < pixels; i++, rgb += 3)
+    sub[i & 3][rgbBinIndex(rgb[0], rgb[1], rgb[2])]++;
+}
+
+#ifdef PAA_X86_SIMD
+__attribute__((target("ssse3")))
+inline void histogramCountSSSE3(const unsigned char *rgb, size_t pixels, uint32_t (*sub)[kHistSize])
+{
+  // máscaras pshufb que separam os canais de 48 bytes RGB em 16 bytes por canal
+  const __m128i r0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i r1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+  const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+  const __m128i g0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+  const __m128i g2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+  const __m128i b0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i b1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+  const __m128i b2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+  const __m128i low3 = _mm_set1_epi8(0x07);
+  const __m128i mid3 = _mm_set1_epi8(0x38);
+  const __m128i zero = _mm_setzero_si128();
+
+  alignas(16) uint16_t idx[16];
+  size_t i = 0;
+  for (; i + 16 <= pixels; i += 16, rgb += 48)
+  {
+    __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb));
+    __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb + 16));
+    __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb + 32));
+    __m128i R = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, r0), _mm_shuffle_epi8(v1, r1)), _mm_shuffle_epi8(v2, r2));
+    __m128i G = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, g0), _mm_shuffle_epi8(v1, g1)), _mm_shuffle_epi8(v2, g2));
+    __m128i B = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, b0), _mm_shuffle_epi8(v1, b1)), _mm_shuffle_epi8(v2, b2));
+
+    // (g>>5)<<3 | b>>5 cabe em 6 bits; r>>5 entra depois em 16 bits
+    __m128i r3 = _mm_and_si128(_mm_srli_epi16(R, 5), low3);
+    __m128i gb = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(G, 2), mid3),
+                              _mm_and_si128(_mm_srli_epi16(B, 5), low3));
+    __m128i lo = _mm_or_si128(_mm_slli_epi16(_mm_unpacklo_epi8(r3, zero), 6), _mm_unpacklo_epi8(gb, zero));
+    __m128i hi = _mm_or_si128(_mm_slli_epi16(_mm_unpackhi_epi8(r3, zero), 6), _mm_unpackhi_epi8(gb, zero));
+    _mm_store_si128(reinterpret_cast<__m128i *>(idx), lo);
+    _mm_store_si128(reinterpret_cast<__m128i *>(idx + 8), hi);
+
+    for (int k = 0; k < 16; k += 4)
+    {
+      sub[0][idx[k + 0]]++;
+      sub[1][idx[k + 1]]++;
+      sub[2][idx[k + 2]]++;
+      sub[3][idx[k + 3]]++;
+    }
+  }
+  histogramCountScalar(rgb, pixels - i, sub);
+}
+#endif
+
+// Histograma RGB 8x8x8 (512 bins) normalizado, escrito direto em "out"
+inline void computeRGBHistogram(const unsigned char *rgb, size_t pixels, float *out)
+{
+  alignas(64) uint32_t sub[4][kHistSize] = {};
+
+#ifdef PAA_X86_SIMD
+  static const bool ssse3 = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3"));
+  if (ssse3)
+    histogramCountSSSE3(rgb, pixels, sub);
+  else
+#endif
+    histogramCountScalar(rgb, pixels, sub);
+
+  histogramNormalize(sub, pixels, out);
+}
+
+// Gera histograma RGB
+inline std::vector<float> computeRGBHistogram(const ImageRGB8 &img)
+{
+  std::vector<float> norm(kHistSize);
+  computeRGBHistogram(img.data.data(), static_cast<size_t>(img.width) * img.height, norm.data());
+  return norm;
+}
+
+// Histograma direto do arquivo mapeado (sem alocar raster). Sem mmap na
+// plataforma, cai no loadPPM_P6 tradicional. pixelBytes recebe w*h*3.
+inline bool histogramFromPPM(const std::string &path, float *out, size_t *pixelBytes = nullptr)
+{
+#ifdef PAA_HAS_MMAP
+  MappedPPM ppm;
+  if (!ppm.open(path))
+    return false;
+  computeRGBHistogram(ppm.pixels(), ppm.pixelCount(), out);
+  if (pixelBytes)
+    *pixelBytes = ppm.pixelCount() * 3;
+  return true;
+#else
+  ImageRGB8 img;
+  if (!loadPPM_P6(path, img))
+    return false;
+  computeRGBHistogram(img.data.data(), static_cast<size_t>(img.width) * img.height, out);
+  if (pixelBytes)
+    *pixelBytes = img.data.size();
+  return true;
+#endif
+}
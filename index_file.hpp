@@ -0,0 +1,485 @@
+// index_file.hpp — arquivo de índice binário versionado, usado direto via mmap
+#pragma once
+#include "feature_store.hpp"
+#include "search_hash.hpp"
+#include "search_mtree.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* -----------------------------------------------------------------------------
+   Layout (little-endian, tipos da própria máquina):
+     [IndexFileHeader][IndexSection x sectionCount][seções, cada uma alinhada a 64]
+
+   Seções conhecidas:
+     FEAT  matriz N x dims de float (mesmo layout do FeatureStore)
+     IDOF  N+1 offsets uint32 dos ids
+     IDCH  caracteres dos ids concatenados
+     SIGN  assinatura SimHash 128 bits (Hash128) de cada linha
+     LSHP  parâmetros do SimHashIndex (SimHashSectionHeader)
+     LSHT  tabelas do SimHashIndex (L x N SimHashBucketEntry, ordenadas)
+     MTRP  parâmetros e raiz da M-Tree (MTreeSectionHeader)
+     MTRN  nós da arena da M-Tree (MTNode)
+     MTRE  entradas da arena da M-Tree (capacity + 1 MTEntry por nó)
+
+   Validação ao abrir:
+     - magic, versão e tamanho dos registros: arquivo de outro formato é rejeitado
+     - checksum do cabeçalho + tabela de seções (sempre)
+     - checksum de todo o conteúdo (opcional: custa uma leitura completa)
+
+   Depois de validado, o conteúdo é usado no lugar (FeatureStore::view),
+   sem desserializar nada.
+-----------------------------------------------------------------------------*/
+
+static constexpr char kIndexMagic[8] = {'P', 'A', 'A', 'I', 'D', 'X', '\0', '\0'};
+static constexpr uint32_t kIndexVersion = 1;
+static constexpr uint64_t kIndexAlign = 64;
+
+static constexpr uint32_t indexTag(const char (&s)[5]) {
+    return (uint32_t)s[0] | ((uint32_t)s[1] << 8) | ((uint32_t)s[2] << 16) | ((uint32_t)s[3] << 24);
+}
+static constexpr uint32_t kTagFeatures   = indexTag("FEAT");
+static constexpr uint32_t kTagIdOffsets  = indexTag("IDOF");
+static constexpr uint32_t kTagIdChars    = indexTag("IDCH");
+static constexpr uint32_t kTagSignatures = indexTag("SIGN");
+static constexpr uint32_t kTagLshParams  = indexTag("LSHP");
+static constexpr uint32_t kTagLshTables  = indexTag("LSHT");
+static constexpr uint32_t kTagMTreeParams  = indexTag("MTRP");
+static constexpr uint32_t kTagMTreeNodes   = indexTag("MTRN");
+static constexpr uint32_t kTagMTreeEntries = indexTag("MTRE");
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;      // sizeof(IndexFileHeader), detecta mudança de layout
+    uint32_t dims;
+    uint32_t sectionCount;
+    uint64_t rows;
+    uint64_t payloadChecksum;  // de tudo após a tabela de seções
+    uint64_t headerChecksum;   // do cabeçalho (com este campo zerado) + tabela
+};
+
+struct IndexSection {
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t offset;           // a partir do início do arquivo
+    uint64_t size;             // em bytes
+};
+
+// FNV-1a sobre palavras de 64 bits (bytes finais completados com zero)
+inline uint64_t indexChecksum(const void* data, size_t bytes, uint64_t h = 0xCBF29CE484222325ULL) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0x100000001B3ULL;
+    }
+    if (i < bytes) {
+        uint64_t w = 0;
+        std::memcpy(&w, p + i, bytes - i);
+        h = (h ^ w) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+// FNV-1a de indexChecksum sobre uma sequência de pedaços de tamanho qualquer
+// (o mesmo valor de indexChecksum sobre os pedaços concatenados)
+class IndexChecksumStream {
+public:
+    void update(const void* data, uint64_t bytes) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        if (carryBytes_) {
+            while (bytes && carryBytes_ < 8) { carry_[carryBytes_++] = *p++; bytes--; }
+            if (carryBytes_ < 8) return;
+            h_ = indexChecksum(carry_, 8, h_);
+            carryBytes_ = 0;
+        }
+        uint64_t whole = bytes / 8 * 8;
+        h_ = indexChecksum(p, whole, h_);
+        std::memcpy(carry_, p + whole, bytes - whole);
+        carryBytes_ = bytes - whole;
+    }
+
+    uint64_t value() const { return carryBytes_ ? indexChecksum(carry_, carryBytes_, h_) : h_; }
+
+private:
+    uint64_t h_ = 0xCBF29CE484222325ULL;
+    unsigned char carry_[8];
+    uint64_t carryBytes_ = 0;
+};
+
+// Monta o arquivo: addSection() guarda ponteiros (os dados precisam viver até
+// write()); uma seção pode vir em vários pedaços, gravados em sequência, ou
+// ser produzida durante write(), na ordem das seções (nada inteiro na memória)
+class IndexFileWriter {
+public:
+    using Piece = std::pair<const void*, uint64_t>;
+    using Sink = std::function<void(const void*, uint64_t)>;
+    using Producer = std::function<void(const Sink&)>;
+
+    IndexFileWriter(uint64_t rows, uint32_t dims) : rows_(rows), dims_(dims) {}
+
+    void addSection(uint32_t tag, const void* data, uint64_t size) {
+        addSection(tag, std::vector<Piece>{{data, size}});
+    }
+
+    void addSection(uint32_t tag, std::vector<Piece> pieces) {
+        uint64_t size = 0;
+        for (const Piece& p : pieces) size += p.second;
+        pending_.push_back({tag, std::move(pieces), size, nullptr});
+    }
+
+    // produce(put) chama put(dados, bytes) quantas vezes quiser; o total
+    // precisa ser size (o deslocamento das seções seguintes já foi fixado)
+    void addSection(uint32_t tag, uint64_t size, Producer produce) {
+        pending_.push_back({tag, {}, size, std::move(produce)});
+    }
+
+    // Grava o cabeçalho provisório, as seções (com o checksum calculado no
+    // caminho) e, no fim, o cabeçalho definitivo no início do arquivo
+    bool write(const std::string& path, std::string* error = nullptr) const {
+        IndexFileHeader header{};
+        std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+        header.version = kIndexVersion;
+        header.headerBytes = sizeof(IndexFileHeader);
+        header.dims = dims_;
+        header.rows = rows_;
+        header.sectionCount = (uint32_t)pending_.size();
+
+        // offsets das seções (alinhados), na ordem do arquivo
+        std::vector<IndexSection> table(pending_.size());
+        uint64_t offset = align(sizeof(IndexFileHeader) + table.size() * sizeof(IndexSection));
+        for (size_t i = 0; i < pending_.size(); i++) {
+            table[i] = {pending_[i].tag, 0, offset, pending_[i].size};
+            offset = align(offset + pending_[i].size);
+        }
+
+        FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) { if (error) *error = "nao foi possivel criar " + path; return false; }
+        bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  (table.empty() || std::fwrite(table.data(), sizeof(IndexSection), table.size(), f) == table.size());
+
+        // o checksum precisa ver exatamente os bytes escritos (padding incluso)
+        static const char zeros[kIndexAlign] = {};
+        IndexChecksumStream payload;
+        uint64_t pos = sizeof(IndexFileHeader) + table.size() * sizeof(IndexSection);
+        auto put = [&](const void* data, uint64_t bytes) {
+            if (!ok || bytes == 0) return;
+            payload.update(data, bytes);
+            ok = std::fwrite(data, 1, bytes, f) == bytes;
+            pos += bytes;
+        };
+        for (size_t i = 0; i < pending_.size() && ok; i++) {
+            put(zeros, table[i].offset - pos);
+            for (const Piece& p : pending_[i].pieces) put(p.first, p.second);
+            if (pending_[i].produce) pending_[i].produce(put);
+            if (ok && pos != table[i].offset + table[i].size) {
+                std::fclose(f);
+                if (error) *error = "secao produzida com tamanho errado em " + path;
+                return false;
+            }
+        }
+
+        header.payloadChecksum = payload.value();
+        header.headerChecksum = 0;
+        uint64_t hc = indexChecksum(&header, sizeof(header));
+        header.headerChecksum = indexChecksum(table.data(), table.size() * sizeof(IndexSection), hc);
+        ok = ok && std::fseek(f, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, f) == 1;
+        ok = (std::fclose(f) == 0) && ok;
+        if (!ok && error) *error = "erro de escrita em " + path;
+        return ok;
+    }
+
+private:
+    struct Pending { uint32_t tag; std::vector<Piece> pieces; uint64_t size; Producer produce; };
+    static uint64_t align(uint64_t x) { return (x + kIndexAlign - 1) / kIndexAlign * kIndexAlign; }
+
+    uint64_t rows_;
+    uint32_t dims_;
+    std::vector<Pending> pending_;
+};
+
+// Arquivo de índice mapeado somente leitura
+class MappedIndexFile {
+public:
+    MappedIndexFile() = default;
+    MappedIndexFile(const MappedIndexFile&) = delete;
+    MappedIndexFile& operator=(const MappedIndexFile&) = delete;
+    ~MappedIndexFile() { close(); }
+
+    bool open(const std::string& path, bool verifyPayload = false) {
+        close();
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return fail("nao foi possivel abrir " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) { ::close(fd); return fail("stat falhou em " + path); }
+        size_ = (size_t)st.st_size;
+        if (size_ < sizeof(IndexFileHeader)) { ::close(fd); return fail("arquivo curto demais"); }
+        void* m = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (m == MAP_FAILED) { size_ = 0; return fail("mmap falhou em " + path); }
+        base_ = static_cast<const unsigned char*>(m);
+#else
+        return fail("mmap indisponivel nesta plataforma");
+#endif
+        std::memcpy(&header_, base_, sizeof(header_));
+        if (std::memcmp(header_.magic, kIndexMagic, sizeof(kIndexMagic)) != 0)
+            return fail("nao e um arquivo de indice");
+        if (header_.version != kIndexVersion || header_.headerBytes != sizeof(IndexFileHeader))
+            return fail("versao " + std::to_string(header_.version) + " do indice incompativel (esperado " +
+                        std::to_string(kIndexVersion) + "); reconstrua com 'build'");
+
+        uint64_t tableBytes = (uint64_t)header_.sectionCount * sizeof(IndexSection);
+        if (sizeof(IndexFileHeader) + tableBytes > size_) return fail("tabela de secoes truncada");
+        sections_ = reinterpret_cast<const IndexSection*>(base_ + sizeof(IndexFileHeader));
+
+        IndexFileHeader h = header_;
+        h.headerChecksum = 0;
+        uint64_t hc = indexChecksum(sections_, tableBytes, indexChecksum(&h, sizeof(h)));
+        if (hc != header_.headerChecksum) return fail("checksum do cabecalho invalido");
+
+        // offsets e tamanhos vêm do arquivo: nada de soma que possa dar a volta
+        for (uint32_t i = 0; i < header_.sectionCount; i++) {
+            const IndexSection& s = sections_[i];
+            if (s.offset > size_ || s.size > size_ - s.offset) return fail("secao fora do arquivo");
+            if (s.offset % kIndexAlign != 0) return fail("secao desalinhada");
+        }
+
+        // a consulta escreve kDims floats por histograma e as linhas são uint32
+        if (header_.dims != FeatureStore::kDims)
+            return fail("indice com " + std::to_string(header_.dims) + " bins por histograma (esperado " +
+                        std::to_string(FeatureStore::kDims) + ")");
+        if (header_.rows >= kNoRow) return fail("linhas demais no indice");
+        uint64_t featureBytes, idOffsetBytes;
+        if (__builtin_mul_overflow(header_.rows, (uint64_t)header_.dims * sizeof(float), &featureBytes) ||
+            __builtin_mul_overflow(header_.rows + 1, (uint64_t)sizeof(uint32_t), &idOffsetBytes))
+            return fail("tamanho das secoes estoura");
+
+        if (verifyPayload) {
+            uint64_t start = sizeof(IndexFileHeader) + tableBytes;
+            if (indexChecksum(base_ + start, size_ - start) != header_.payloadChecksum)
+                return fail("checksum do conteudo invalido");
+        }
+
+        const float* features = section<float>(kTagFeatures, featureBytes);
+        const uint32_t* idOffsets = section<uint32_t>(kTagIdOffsets, idOffsetBytes);
+        const char* idChars = section<char>(kTagIdChars, 0);
+        if (!features || !idOffsets || !idChars) return fail("secoes de features/ids ausentes");
+        // id(r) = [off[r], off[r+1]): começa em 0, nunca volta e cabe em IDCH
+        if (idOffsets[0] != 0 || idOffsets[header_.rows] > sectionSize(kTagIdChars)) return fail("ids inconsistentes");
+        for (uint64_t r = 0; r < header_.rows; r++)
+            if (idOffsets[r] > idOffsets[r + 1]) return fail("ids inconsistentes");
+
+        store_ = FeatureStore::view(features, (uint32_t)header_.rows, header_.dims, idOffsets, idChars);
+        return true;
+    }
+
+    void close() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (base_) munmap(const_cast<unsigned char*>(base_), size_);
+#endif
+        base_ = nullptr;
+        sections_ = nullptr;
+        size_ = 0;
+        store_ = FeatureStore();
+    }
+
+    const std::string& error() const { return error_; }
+    const IndexFileHeader& header() const { return header_; }
+    const FeatureStore& store() const { return store_; }
+    size_t fileBytes() const { return size_; }
+
+    // Ponteiro para a seção "tag" com pelo menos minBytes (nullptr se ausente)
+    template <class T>
+    const T* section(uint32_t tag, uint64_t minBytes) const {
+        for (uint32_t i = 0; sections_ && i < header_.sectionCount; i++)
+            if (sections_[i].tag == tag && sections_[i].size >= minBytes)
+                return reinterpret_cast<const T*>(base_ + sections_[i].offset);
+        return nullptr;
+    }
+
+    uint64_t sectionSize(uint32_t tag) const {
+        for (uint32_t i = 0; sections_ && i < header_.sectionCount; i++)
+            if (sections_[i].tag == tag) return sections_[i].size;
+        return 0;
+    }
+
+private:
+    bool fail(const std::string& msg) {
+        std::string keep = msg;
+        close();
+        error_ = keep;
+        return false;
+    }
+
+    const unsigned char* base_ = nullptr;
+    const IndexSection* sections_ = nullptr;
+    size_t size_ = 0;
+    IndexFileHeader header_{};
+    FeatureStore store_;
+    std::string error_;
+};
+
+// Ids no layout do arquivo (N+1 offsets + caracteres); precisa viver até write()
+struct StoreIdSections {
+    std::vector<uint32_t> offsets;
+    std::vector<char> chars;
+};
+
+// Seções básicas (features + ids) de um store; FEAT sai bloco a bloco do store
+inline void addStoreSections(IndexFileWriter& w, const FeatureStore& store, StoreIdSections& ids) {
+    std::vector<IndexFileWriter::Piece> rows;
+    for (uint32_t r = 0; r < store.size();) {
+        uint32_t n = (uint32_t)std::min<size_t>(store.contiguousRows(r), store.size() - r);
+        rows.push_back({store.row(r), (uint64_t)n * store.dims() * sizeof(float)});
+        r += n;
+    }
+    w.addSection(kTagFeatures, std::move(rows));
+    store.exportIds(ids.offsets, ids.chars);
+    w.addSection(kTagIdOffsets, ids.offsets.data(), ids.offsets.size() * sizeof(uint32_t));
+    w.addSection(kTagIdChars, ids.chars.data(), ids.chars.size());
+}
+
+struct SimHashSectionHeader {
+    uint32_t tables, bandBits, probes, reserved;
+    uint64_t count;
+};
+
+inline SimHashSectionHeader simHashSectionHeader(const SimHashIndexParams& params, uint64_t count) {
+    return {params.tables, params.bandBits, params.probes, 0, count};
+}
+
+// Seções do SimHashIndex (assinaturas + tabelas, com as caudas de insert()
+// fundidas antes); header precisa viver até write()
+inline void addSimHashSections(IndexFileWriter& w, SimHashIndex& index,
+                               const FeatureStore& store, SimHashSectionHeader& header) {
+    index.flush();
+    header = simHashSectionHeader(index.params(), index.size());
+    w.addSection(kTagSignatures, index.signatures(), (uint64_t)store.size() * sizeof(Hash128));
+    w.addSection(kTagLshParams, &header, sizeof(header));
+    w.addSection(kTagLshTables, index.entries(), index.entryCount() * sizeof(SimHashBucketEntry));
+}
+
+// Liga o índice às seções mapeadas; false se o arquivo não tiver as tabelas ou
+// se elas não forem válidas (linhas dentro do store, cada tabela ordenada pela
+// chave): as linhas vão direto para as assinaturas e o store na consulta
+inline bool attachSimHashSections(const MappedIndexFile& file, SimHashIndex& index) {
+    const SimHashSectionHeader* h = file.section<SimHashSectionHeader>(kTagLshParams, sizeof(SimHashSectionHeader));
+    const Hash128* sigs = file.section<Hash128>(kTagSignatures, (uint64_t)file.store().size() * sizeof(Hash128));
+    if (!h || !sigs) return false;
+    uint64_t tableBytes;
+    if (h->tables == 0 || h->bandBits == 0 || h->bandBits > 64 || h->count > file.store().size() ||
+        __builtin_mul_overflow((uint64_t)h->tables * h->count, (uint64_t)sizeof(SimHashBucketEntry), &tableBytes))
+        return false;
+    const SimHashBucketEntry* entries = file.section<SimHashBucketEntry>(kTagLshTables, tableBytes);
+    if (!entries) return false;
+    const uint32_t rows = file.store().size();
+    for (uint32_t t = 0; t < h->tables; t++) {
+        const SimHashBucketEntry* table = entries + (size_t)t * h->count;
+        for (uint64_t i = 0; i < h->count; i++) {
+            if (table[i].row >= rows) return false;
+            if (i > 0 && table[i].key < table[i - 1].key) return false;
+        }
+    }
+    SimHashIndexParams params;
+    params.tables = h->tables;
+    params.bandBits = h->bandBits;
+    params.probes = h->probes;
+    index.attach(params, h->count, entries, sigs);
+    return true;
+}
+
+struct MTreeSectionHeader {
+    char distance[16];         // Distance::name da árvore gravada
+    uint32_t capacity, root, nodes, promotion;
+    uint32_t partition, samples;
+    uint64_t seed;
+    uint64_t count;
+};
+
+// Seções da M-Tree (arena página a página, sem cópia); header precisa viver até write()
+template <class Distance>
+inline void addMTreeSections(IndexFileWriter& w, const BasicMTree<Distance>& tree, MTreeSectionHeader& header) {
+    header = {};
+    std::strncpy(header.distance, Distance::name, sizeof(header.distance) - 1);
+    const MTreeParams& p = tree.params();
+    header.capacity = (uint32_t)p.capacity;
+    header.root = tree.root();
+    header.nodes = (uint32_t)tree.arenaNodes();
+    header.promotion = (uint32_t)p.promotion;
+    header.partition = (uint32_t)p.partition;
+    header.samples = (uint32_t)p.samples;
+    header.seed = p.seed;
+    header.count = tree.size();
+    std::vector<IndexFileWriter::Piece> nodes, entries;
+    tree.forEachArenaPage([&](const MTNode* n, uint32_t count, const MTEntry* e) {
+        nodes.push_back({n, (uint64_t)count * sizeof(MTNode)});
+        entries.push_back({e, (uint64_t)count * (p.capacity + 1) * sizeof(MTEntry)});
+    });
+    w.addSection(kTagMTreeParams, &header, sizeof(header));
+    w.addSection(kTagMTreeNodes, std::move(nodes));
+    w.addSection(kTagMTreeEntries, std::move(entries));
+}
+
+// Liga a árvore à arena mapeada; false se o arquivo não tiver a M-Tree desta
+// distância ou se a arena não for uma árvore válida (filhos e linhas dentro
+// dos limites, cada nó alcançado uma vez, altura <= 64, count itens nas folhas)
+template <class Distance>
+inline bool attachMTreeSections(const MappedIndexFile& file, BasicMTree<Distance>& tree) {
+    const MTreeSectionHeader* h = file.section<MTreeSectionHeader>(kTagMTreeParams, sizeof(MTreeSectionHeader));
+    if (!h || std::strncmp(h->distance, Distance::name, sizeof(h->distance)) != 0) return false;
+    if (h->capacity < 2 || h->capacity > 4096 || h->nodes >= kNoRow ||
+        h->promotion > (uint32_t)MTreePromotion::MinSumRadius || h->partition > (uint32_t)MTreePartition::Balanced)
+        return false;
+    const uint64_t stride = (uint64_t)h->capacity + 1;
+    const MTNode* nodes = file.section<MTNode>(kTagMTreeNodes, (uint64_t)h->nodes * sizeof(MTNode));
+    const MTEntry* entries = file.section<MTEntry>(kTagMTreeEntries, (uint64_t)h->nodes * stride * sizeof(MTEntry));
+    if (!nodes || !entries) return false;
+
+    const uint32_t rows = file.store().size();
+    uint64_t items = 0;
+    if (h->root != kNoRow) {
+        if (h->root >= h->nodes) return false;
+        std::vector<uint8_t> seen(h->nodes, 0);
+        std::vector<std::pair<uint32_t, uint32_t>> stack{{h->root, 0}};   // (nó, profundidade)
+        seen[h->root] = 1;
+        while (!stack.empty()) {
+            auto [node, depth] = stack.back();
+            stack.pop_back();
+            const MTNode& n = nodes[node];
+            if (n.count > h->capacity || depth > 64) return false;
+            const MTEntry* e = entries + node * stride;
+            for (uint32_t i = 0; i < n.count; i++) {
+                if (e[i].row >= rows) return false;
+                if (n.leaf) continue;
+                if (e[i].child >= h->nodes || seen[e[i].child]) return false;
+                seen[e[i].child] = 1;
+                stack.push_back({e[i].child, depth + 1});
+            }
+            if (n.leaf) items += n.count;
+        }
+    }
+    if (items != h->count) return false;
+
+    MTreeParams params;
+    params.capacity = h->capacity;
+    params.promotion = (MTreePromotion)h->promotion;
+    params.partition = (MTreePartition)h->partition;
+    params.samples = h->samples;
+    params.seed = h->seed;
+    tree.attach(params, h->root, h->count, h->nodes, nodes, entries);
+    return true;
+}
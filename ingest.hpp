@@ -0,0 +1,112 @@
+// ingest.hpp — carga paralela das imagens direto no FeatureStore
+#pragma once
+#include "feature_store.hpp"
+#include "histogram.hpp"
+#include "ppm_loader.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - Reserva uma linha no store para cada imagem (ids na ordem dos caminhos).
+     - Um produtor enfileira os números de linha em uma fila limitada; as
+       threads do pool mapeiam o PPM (mmap) e calculam o histograma direto dos
+       bytes mapeados, escrevendo na linha (sem alocar o raster).
+     - Log por imagem desligado por padrão; ao final reporta imagens/s e MB/s.
+
+   API:
+     IngestStats ingestImages(const std::vector<std::string>& paths,
+                              const std::vector<std::string>& ids,
+                              FeatureStore& store,
+                              const IngestOptions& opt = {});
+-----------------------------------------------------------------------------*/
+
+struct IngestOptions
+{
+    int threads = defaultThreadCount();
+    size_t queueCapacity = 64;   // jobs pendentes no máximo
+    bool verbose = false;        // log por imagem
+};
+
+struct IngestStats
+{
+    size_t images = 0;           // imagens carregadas com sucesso
+    uint64_t bytes = 0;          // bytes de pixels lidos
+    double seconds = 0.0;
+    std::vector<std::string> failed;
+
+    double imagesPerSecond() const { return seconds > 0 ? images / seconds : 0.0; }
+    double megabytesPerSecond() const { return seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0.0; }
+
+    void print() const
+    {
+        std::cout << "Ingestao: " << images << " imagens em " << seconds * 1000.0 << " ms ("
+                  << imagesPerSecond() << " img/s, " << megabytesPerSecond() << " MB/s)";
+        if (!failed.empty())
+            std::cout << " | " << failed.size() << " falha(s)";
+        std::cout << "\n";
+    }
+};
+
+inline IngestStats ingestImages(const std::vector<std::string> &paths,
+                                const std::vector<std::string> &ids,
+                                FeatureStore &store,
+                                const IngestOptions &opt = {})
+{
+    IngestStats stats;
+    auto start = std::chrono::steady_clock::now();
+
+    // linhas criadas antes das threads: o store não realoca durante a carga
+    store.reserve(store.size() + paths.size());
+    std::vector<uint32_t> rows(paths.size());
+    for (size_t i = 0; i < paths.size(); i++)
+        rows[i] = store.add(ids[i]);
+
+    BoundedQueue<size_t> jobs(opt.queueCapacity);
+    std::atomic<size_t> loaded{0};
+    std::atomic<uint64_t> bytes{0};
+    std::mutex logMutex;
+
+    ThreadPool pool(opt.threads);
+    for (int t = 0; t < pool.size(); t++)
+    {
+        pool.submit([&] {
+            size_t job;
+            while (jobs.pop(job))
+            {
+                size_t pixelBytes = 0;
+                if (!histogramFromPPM(paths[job], store.row(rows[job]), &pixelBytes))
+                {
+                    std::lock_guard<std::mutex> lock(logMutex);
+                    std::cerr << "Falha ao carregar PPM: " << paths[job] << "\n";
+                    stats.failed.push_back(paths[job]);
+                    continue;
+                }
+                loaded++;
+                bytes += pixelBytes;
+
+                if (opt.verbose)
+                {
+                    std::lock_guard<std::mutex> lock(logMutex);
+                    std::cout << "Carregado PPM P6 " << paths[job] << " (" << pixelBytes << " bytes)\n";
+                }
+            }
+        });
+    }
+
+    for (size_t i = 0; i < paths.size(); i++)
+        jobs.push(i);
+    jobs.close();
+    pool.wait();
+
+    stats.images = loaded;
+    stats.bytes = bytes;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
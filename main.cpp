@@ -1,12 +1,21 @@
 #include "ppm_loader.hpp"
+#include "feature_store.hpp"
+#include "ingest.hpp"
+#include "index_file.hpp"
 #include "search_list.hpp"
 #include "search_hash.hpp"
 #include "search_quadtree.hpp"
 #include "search_mtree.hpp"
+#include "quantized_store.hpp"
+#include "sparse_store.hpp"
+#include "coarse_filter.hpp"
+#include "synthetic_dataset.hpp"
 #include <iostream>
 #include <vector>
 #include <limits>
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
 using namespace std;
 
 // Função para medir tempo
@@ -18,228 +27,443 @@ double ms(chrono::high_resolution_clock::time_point start,
   return chrono::duration<double, milli>(end - start).count();
 }
 
-// Gera histograma RGB
-vector<float> computeRGBHistogram(const ImageRGB8 &img)
+// Candidatos do hash re-ranqueados pelo qui-quadrado exato (recall x latência)
+static size_t hashRerank = 32;
+static MTreeParams mtreeParams;
+static size_t demoK = 3;
+static float demoRadius = -1.0f; // < 0: sem consulta por raio
+static bool showStats = false;     // custo de cada consulta + histogramas (query_stats.hpp)
+static bool quantize = false;      // demo também nas linhas compactas (quantized_store.hpp)
+static RowFormat quantizeFormat = RowFormat::U8;
+static bool sparse = false;        // demo também nas linhas esparsas (sparse_store.hpp)
+static bool coarse = false;        // demo também com o filtro da pirâmide 8/64 bins (coarse_filter.hpp)
+static size_t genRows = 1000000;   // modo generate
+static SyntheticParams genParams;
+static bool genLsh = true;
+
+// Caminhos das imagens (agora em bulk)
+static const int startIdx = 1;
+static const int endIdx = 100;
+
+// Carrega imagens e histogramas direto no store contíguo (em paralelo)
+static bool loadImages(FeatureStore &store, const IngestOptions &ingestOpt)
 {
-  const int bins = 8;
-  vector<int> hist(bins * bins * bins, 0);
+    vector<string> paths, ids;
+    for (int i = startIdx; i <= endIdx; i++)
+    {
+        paths.push_back("images/img" + to_string(i) + ".ppm");
+        ids.push_back("imagem_" + to_string(i));
+    }
 
-  for (int i = 0; i < img.width * img.height; i++)
-  {
-    unsigned char R = img.data[i * 3 + 0];
-    unsigned char G = img.data[i * 3 + 1];
-    unsigned char B = img.data[i * 3 + 2];
+    IngestStats ingest = ingestImages(paths, ids, store, ingestOpt);
+    ingest.print();
 
-    int rBin = R * bins / 256;
-    int gBin = G * bins / 256;
-    int bBin = B * bins / 256;
+    if (!ingest.failed.empty())
+    {
+        cerr << "Erro ao carregar imagem " << ingest.failed.front() << ". Encerrando.\n";
+        return false;
+    }
+    return true;
+}
 
-    int idx = (rBin * bins + gBin) * bins + bBin;
-    hist[idx]++;
-  }
+// BUILD: ingere as imagens uma vez e grava o índice binário
+static int runBuild(const string &indexPath, const IngestOptions &ingestOpt)
+{
+    FeatureStore store;
+    if (!loadImages(store, ingestOpt))
+        return 1;
 
-  float total = static_cast<float>(img.width * img.height);
-  vector<float> norm(hist.size());
-  for (size_t i = 0; i < hist.size(); i++)
-    norm[i] = hist[i] / total;
+    auto t1 = Clock::now();
+    SimHashIndex hashIndex(store);
+    hashIndex.build(store.allRows());
+    MTree tree(store, mtreeParams);
+    tree.bulkLoad(store.allRows(), ingestOpt.threads);
+
+    IndexFileWriter writer(store.size(), (uint32_t)store.dims());
+    StoreIdSections ids;
+    addStoreSections(writer, store, ids);
+    SimHashSectionHeader hashHeader;
+    addSimHashSections(writer, hashIndex, store, hashHeader);
+    MTreeSectionHeader treeHeader;
+    addMTreeSections(writer, tree, treeHeader);
+
+    string error;
+    if (!writer.write(indexPath, &error))
+    {
+        cerr << "Falha ao gravar indice: " << error << "\n";
+        return 1;
+    }
+    auto t2 = Clock::now();
 
-  return norm;
+    cout << "Indice gravado em " << indexPath << " (" << store.size() << " imagens, "
+         << ms(t1, t2) << " ms)\n";
+    return 0;
 }
 
-bool loadDescribeAndHistogram(const string &path, ImageRGB8 &outImg, vector<float> &outHist)
+// GENERATE: base sintética em volta dos histogramas de images/ (as que
+// carregarem; sem nenhuma, protótipos sorteados), gravada como índice
+static int runGenerate(const string &indexPath, const IngestOptions &ingestOpt)
 {
-  if (!loadPPM_P6(path, outImg))
-  {
-    cerr << "Falha ao carregar PPM: " << path << "\n";
-    return false;
-  }
-  cout << "\nCarregado PPM P6 " << outImg.width << "x" << outImg.height
-       << " (" << outImg.data.size() << " bytes)\n";
-
-  if (!outImg.data.empty())
-  {
-    unsigned char R0 = outImg.data[0], G0 = outImg.data[1], B0 = outImg.data[2];
-    cout << "Pixel(0,0) R=" << (int)R0
-         << " G=" << (int)G0
-         << " B=" << (int)B0 << "\n";
-  }
-
-  outHist = computeRGBHistogram(outImg);
-  cout << "Histograma calculado! Tamanho = " << outHist.size() << "\n";
-  return true;
-}
+    FeatureStore seeds;
+    vector<string> paths, ids;
+    for (int i = startIdx; i <= endIdx; i++)
+    {
+        paths.push_back("images/img" + to_string(i) + ".ppm");
+        ids.push_back("imagem_" + to_string(i));
+    }
+    IngestOptions quiet = ingestOpt;
+    quiet.verbose = false;
+    ingestImages(paths, ids, seeds, quiet);
 
-// Distância qui-quadrado
-float chiSquare(vector<float> &referenceHistogram, vector<float> &queryHistogram)
-{
-  float sum = 0.0f;
-  size_t binCount = referenceHistogram.size();
+    // linhas de imagens que falharam ficam zeradas: não servem de semente
+    vector<const float *> seedRows;
+    for (uint32_t r = 0; r < seeds.size(); r++)
+    {
+        const float *h = seeds.row(r);
+        float total = 0.0f;
+        for (size_t b = 0; b < seeds.dims(); b++)
+            total += h[b];
+        if (total > 0.0f)
+            seedRows.push_back(h);
+    }
 
-  for (size_t i = 0; i < binCount; i++)
-  {
-    float denominator = referenceHistogram[i] + queryHistogram[i];
-    if (denominator != 0.0f)
+    auto t1 = Clock::now();
+    ThreadPool pool(ingestOpt.threads);
+    string error;
+    if (!writeSyntheticIndex(indexPath, genRows, seedRows, genParams, pool, genLsh, &error))
     {
-      float difference = referenceHistogram[i] - queryHistogram[i];
-      sum += (difference * difference) / denominator;
+        cerr << "Falha ao gerar indice: " << error << "\n";
+        return 1;
     }
-  }
-  return sum;
+    auto t2 = Clock::now();
+
+    cout << "Indice sintetico gravado em " << indexPath << " (" << genRows << " linhas, "
+         << seedRows.size() << " sementes, " << genParams.clusters << " centros, seed " << genParams.seed
+         << (genLsh ? ", com" : ", sem") << " tabelas SimHash, " << ms(t1, t2) << " ms)\n";
+    return 0;
 }
 
-// Busca linear
-ListSearchResult searchMostSimilar(vector<ImageItem> &index, ImageItem &queryImage)
+// QUERY: apenas mapeia o índice (sem re-histogramar a base) e responde a consulta
+static int runQuery(const string &indexPath, const string &queryPath, bool verify, int threads)
 {
-  string bestId = "";
-  float bestDistance = numeric_limits<float>::infinity();
+    auto t1 = Clock::now();
+    MappedIndexFile index;
+    if (!index.open(indexPath, verify))
+    {
+        cerr << "Indice rejeitado: " << index.error() << "\n";
+        return 1;
+    }
+    auto t2 = Clock::now();
+
+    const FeatureStore &store = index.store();
+    vector<float> query(store.dims());
+    if (!histogramFromPPM(queryPath, query.data()))
+    {
+        cerr << "Falha ao carregar PPM: " << queryPath << "\n";
+        return 1;
+    }
+    auto t3 = Clock::now();
 
-  for (size_t i = 0; i < index.size(); i++)
-  {
-    float d = chiSquare(index[i].histogram, queryImage.histogram);
-    if (d < bestDistance)
+    vector<uint32_t> base = store.allRows();
+    SimHashIndex hashIndex(store);
+    if (!attachSimHashSections(index, hashIndex))
     {
-      bestId = index[i].id;
-      bestDistance = d;
+        cerr << "Tabelas SimHash ausentes ou invalidas no indice; reconstrua com 'build'.\n";
+        return 1;
     }
-  }
-  return ListSearchResult(bestId, bestDistance);
+    // M-Tree mapeada no lugar; índices de 'generate' não a trazem
+    MTree tree(store);
+    bool hasTree = attachMTreeSections(index, tree);
+    ThreadPool pool(threads);
+    auto t4 = Clock::now();
+
+    // as buscas primeiro, a impressão depois: os tempos são só das buscas
+    // (lista = verdade exata: varredura paralela em todos os núcleos)
+    QueryStats listStats, hashStats, treeStats;
+    ListSearchResult listRes = searchMostSimilarParallel(store, base, query.data(), pool, &listStats);
+    auto t5 = Clock::now();
+    HashSearchResult hashRes = hashIndex.searchReranked(query.data(), 3, hashRerank, &hashStats);
+    auto t6 = Clock::now();
+    vector<Neighbor> treeHits;
+    if (hasTree)
+        treeHits = tree.knn(query.data(), 3, &treeStats);
+    auto t7 = Clock::now();
+
+    cout << "\n== BUSCA EM LISTA ==\n";
+    listRes.print(store);
+    hashRes.print(store);
+    cout << "\n== BUSCA EM M-TREE (" << MTree::distance_type::name << ") ==\n";
+    if (hasTree)
+        printNeighbors(store, treeHits);
+    else
+        cout << "M-Tree ausente ou invalida no indice; reconstrua com 'build'.\n";
+
+    recordQueryStats(listStats);
+    recordQueryStats(hashStats);
+    if (hasTree)
+        recordQueryStats(treeStats);
+    if (showStats)
+    {
+        cout << "\nLista: ";
+        printQueryStats(cout, listStats);
+        cout << "Hash: ";
+        printQueryStats(cout, hashStats);
+        if (hasTree)
+        {
+            cout << "M-Tree: ";
+            printQueryStats(cout, treeStats);
+        }
+        cout << "\n== HISTOGRAMAS DAS CONSULTAS ==\n";
+        dumpQueryStats(cout);
+    }
+
+    cout << "\n===== TEMPOS (ms) =====\n";
+    cout << "Mapear indice: " << ms(t1, t2) << " (" << store.size() << " imagens, "
+         << index.fileBytes() << " bytes)\n";
+    cout << "Histograma da consulta: " << ms(t2, t3) << "\n";
+    cout << "Ligar hash/M-Tree ao indice + threads: " << ms(t3, t4) << "\n";
+    cout << "Lista (" << pool.size() << " threads): busca=" << ms(t4, t5) << " | Hash: busca=" << ms(t5, t6);
+    if (hasTree)
+        cout << " | M-Tree: busca=" << ms(t6, t7);
+    cout << "\n";
+    return 0;
 }
 
-// MAIN
-int main()
+static int usage(const char *prog)
 {
-    // Caminhos das imagens (agora em bulk)
-    int startIdx = 1;
-    int endIdx = 100;
+    cerr << "Uso: " << prog << " [--threads N] [--verbose] [--rerank C]\n"
+         << "          [--k K] [--range R] [--fanout N] [--promote random|sampling|mmrad|mrad] [--partition hyperplane|balanced] [--stats]\n"
+         << "          [--quantize u8|u16|f16] [--sparse] [--coarse]\n"
+         << "     " << prog << " build <indice.bin> [--threads N] [--verbose]\n"
+         << "     " << prog << " generate <indice.bin> [--rows N] [--seed S] [--clusters C] [--no-lsh] [--threads N]\n"
+         << "     " << prog << " query <indice.bin> <consulta.ppm> [--verify] [--rerank C] [--threads N] [--stats]\n";
+    return 1;
+}
 
-    // Carrega imagens e histogramas
-    vector<ImageItem> allImages;
+static int runDemo(const IngestOptions &ingestOpt);
 
-    for (int i = startIdx; i <= endIdx; i++)
+static bool parseCount(const char *text, size_t &out)
+{
+    char *end;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (end == text || *end)
+        return false;
+    out = (size_t)v;
+    return true;
+}
+
+// MAIN
+int main(int argc, char **argv)
+{
+    string mode, indexPath, queryPath;
+    int a = 1;
+    if (argc > 1 && (!strcmp(argv[1], "build") || !strcmp(argv[1], "query") || !strcmp(argv[1], "generate")))
     {
-        string path = "images/img" + to_string(i) + ".ppm";
-        ImageRGB8 img;
-        vector<float> hist;
+        mode = argv[1];
+        if (argc < (mode == "query" ? 4 : 3))
+            return usage(argv[0]);
+        indexPath = argv[2];
+        if (mode == "query")
+            queryPath = argv[3];
+        a = mode == "query" ? 4 : 3;
+    }
 
-        if (!loadDescribeAndHistogram(path, img, hist))
+    IngestOptions ingestOpt;
+    bool verify = false;
+    for (; a < argc; a++)
+    {
+        if (!strcmp(argv[a], "--threads") && a + 1 < argc)
+            ingestOpt.threads = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--verbose") || !strcmp(argv[a], "-v"))
+            ingestOpt.verbose = true;
+        else if (!strcmp(argv[a], "--rerank") && a + 1 < argc)
+            hashRerank = (size_t)atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--k") && a + 1 < argc)
+            demoK = (size_t)atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--range") && a + 1 < argc)
+            demoRadius = (float)atof(argv[++a]);
+        else if (!strcmp(argv[a], "--fanout") && a + 1 < argc)
+            mtreeParams.capacity = (size_t)atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--promote") && a + 1 < argc)
         {
-            cerr << "Erro ao carregar imagem " << path << ". Encerrando.\n";
-            return 1;
+            if (!parseMTreePromotion(argv[++a], mtreeParams.promotion))
+                return usage(argv[0]);
         }
-
-        string id = "imagem_" + to_string(i);
-        allImages.push_back(ImageItem(id, hist));
+        else if (!strcmp(argv[a], "--partition") && a + 1 < argc)
+        {
+            if (!parseMTreePartition(argv[++a], mtreeParams.partition))
+                return usage(argv[0]);
+        }
+        else if (!strcmp(argv[a], "--stats"))
+            showStats = true;
+        else if (!strcmp(argv[a], "--quantize") && a + 1 < argc && mode.empty())
+        {
+            if (!parseRowFormat(argv[++a], quantizeFormat))
+                return usage(argv[0]);
+            quantize = true;
+        }
+        else if (!strcmp(argv[a], "--sparse") && mode.empty())
+            sparse = true;
+        else if (!strcmp(argv[a], "--coarse") && mode.empty())
+            coarse = true;
+        else if (!strcmp(argv[a], "--verify") && mode == "query")
+            verify = true;
+        else if (!strcmp(argv[a], "--rows") && a + 1 < argc && mode == "generate")
+        {
+            if (!parseCount(argv[++a], genRows) || genRows == 0)
+                return usage(argv[0]);
+        }
+        else if (!strcmp(argv[a], "--seed") && a + 1 < argc && mode == "generate")
+            genParams.seed = strtoull(argv[++a], nullptr, 10);
+        else if (!strcmp(argv[a], "--clusters") && a + 1 < argc && mode == "generate")
+        {
+            if (!parseCount(argv[++a], genParams.clusters) || genParams.clusters == 0)
+                return usage(argv[0]);
+        }
+        else if (!strcmp(argv[a], "--no-lsh") && mode == "generate")
+            genLsh = false;
+        else
+            return usage(argv[0]);
     }
 
-    if (allImages.size() < 2)
+    if (mode == "build")
+        return runBuild(indexPath, ingestOpt);
+    if (mode == "generate")
+        return runGenerate(indexPath, ingestOpt);
+    if (mode == "query")
+        return runQuery(indexPath, queryPath, verify, ingestOpt.threads);
+    return runDemo(ingestOpt);
+}
+
+// DEMO: carrega as imagens e compara as quatro estruturas
+static int runDemo(const IngestOptions &ingestOpt)
+{
+    FeatureStore store;
+    if (!loadImages(store, ingestOpt))
+        return 1;
+
+    if (store.size() < 2)
     {
         cerr << "Eh necessario pelo menos 2 imagens (1 base + 1 consulta).\n";
         return 1;
     }
 
     // última imagem do intervalo será a imagem de consulta
-    ImageItem imageQueryItem = allImages[allImages.size() - 1];
+    const float *imageQuery = store.row(store.size() - 1);
 
-    // base = todas menos a última
-    vector<ImageItem> imagesList;
-    for (int i = 0; i < (int)allImages.size() - 1; i++)
+    // base = todas menos a última (apenas números de linha)
+    vector<uint32_t> imagesList;
+    for (uint32_t i = 0; i + 1 < store.size(); i++)
     {
-        imagesList.push_back(allImages[i]);
+        imagesList.push_back(i);
     }
 
     // BUSCAS NORMAIS (SEM TEMPO)
     cout << "\n\n== BUSCA EM LISTA ==\n";
-    ListSearchResult listRes0 = searchMostSimilar(imagesList, imageQueryItem);
-    listRes0.print();
-
-    vector<ImageItem> imagesHashBase;
-    for (int i = 0; i < (int)imagesList.size(); i++)
-        imagesHashBase.push_back(imagesList[i]);
+    ListSearchResult listRes0 = searchMostSimilar(store, imagesList, imageQuery);
+    listRes0.print(store);
 
-    HashSearchResult hashRes0 = searchMostSimilarHash(imagesHashBase, imageQueryItem, 3);
-    hashRes0.print();
+    SimHashIndex hashIndex0(store);
+    hashIndex0.build(imagesList);
+    HashSearchResult hashRes0 = hashIndex0.searchReranked(imageQuery, 3, hashRerank);
+    hashRes0.print(store);
 
     cout << "\n\n== BUSCA POR QUADTREE ==\n";
-    vector<ImageItem> imagesQTBase;
-    for (int i = 0; i < (int)imagesList.size(); i++)
-        imagesQTBase.push_back(imagesList[i]);
-
-    QuadtreeSearchResult qtRes0 = searchMostSimilarQuadtree(imagesQTBase, imageQueryItem);
-    qtRes0.print();
-
-    cout << "\n\n== BUSCA EM M-TREE ==\n";
-    MTree tree0;
-    for (int i = 0; i < (int)imagesList.size(); i++)
-        tree0.insert(imagesList[i]);
-
-    MTreeSearchResult mtreeRes0 = tree0.searchMostSimilar(imageQueryItem);
-    mtreeRes0.print();
-
-    // =======================================================
-    // =============    TESTE DE TEMPO   ======================
-    // =======================================================
-    cout << "\n\n===== TESTE DE TEMPO =====\n";
-
-    // LISTA -----------------
-    auto t1 = Clock::now();
-    vector<ImageItem> listBase;
-    for (int i = 0; i < (int)imagesList.size(); i++)
-        listBase.push_back(imagesList[i]);
-    auto t2 = Clock::now();
-
-    auto b1 = Clock::now();
-    ListSearchResult listRes = searchMostSimilar(listBase, imageQueryItem);
-    auto b2 = Clock::now();
-
-    double listBuild = ms(t1, t2);
-    double listSearch = ms(b1, b2);
-
-    // HASH -----------------
-    auto h1 = Clock::now();
-    vector<ImageItem> hashBase;
-    for (int i = 0; i < (int)imagesList.size(); i++)
-        hashBase.push_back(imagesList[i]);
-    auto h2 = Clock::now();
-
-    auto hb1 = Clock::now();
-    HashSearchResult hashRes2 = searchMostSimilarHash(hashBase, imageQueryItem, 1);
-    auto hb2 = Clock::now();
-
-    double hashBuild = ms(h1, h2);
-    double hashSearch = ms(hb1, hb2);
-
-    // QUADTREE -----------------
-    auto q1 = Clock::now();
-    vector<ImageItem> qtBase;
-    for (int i = 0; i < (int)imagesList.size(); i++)
-        qtBase.push_back(imagesList[i]);
-
-    QuadtreeSearchResult qtRes2 = searchMostSimilarQuadtree(qtBase, imageQueryItem);
-    auto q2 = Clock::now();
-
-    double qtBuild_Total = ms(q1, q2);
-    double qtSearch = qtBuild_Total; // busca integrada
+    QuadtreeIndex quadtree0(store);
+    quadtree0.build(imagesList);
+    QuadtreeSearchResult qtRes0 = quadtree0.searchMostSimilar(imageQuery);
+    qtRes0.print(store);
+
+    cout << "\n\n== BUSCA EM M-TREE (" << MTree::distance_type::name << ") ==\n";
+    MTree tree0(store, mtreeParams);
+    tree0.build(imagesList);
+
+    MTreeSearchResult mtreeRes0 = tree0.searchMostSimilar(imageQuery);
+    mtreeRes0.print(store);
+
+    // cada estrutura com o custo da consulta (contado em QueryStats)
+    cout << "\n\n== K-NN (k=" << demoK << ") ==\n";
+    auto knnLine = [&](const char *engine, const vector<Neighbor> &hits, const QueryStats &stats) {
+        cout << engine << (showStats ? " " : ":\n");
+        if (showStats)
+            printQueryStats(cout, stats);
+        printNeighbors(store, hits);
+        recordQueryStats(stats);
+    };
+    QueryStats listStats, hashStats, qtStats, mtStats;
+    vector<Neighbor> listKnn = searchKnn(store, imagesList, imageQuery, demoK, &listStats);
+    knnLine("Lista", listKnn, listStats);
+    vector<Neighbor> hashKnn = hashIndex0.knn(imageQuery, demoK, hashRerank, &hashStats);
+    knnLine("Hash", hashKnn, hashStats);
+    vector<Neighbor> qtKnn = quadtree0.knn(imageQuery, demoK, &qtStats);
+    knnLine("Quadtree", qtKnn, qtStats);
+    vector<Neighbor> mtKnn = tree0.knn(imageQuery, demoK, &mtStats);
+    knnLine("M-Tree", mtKnn, mtStats);
+
+    // mesmo k-NN sobre as linhas compactas: aproximado (só códigos) e exato
+    // (re-rank nas linhas float limitado pelo erro de cada linha)
+    if (quantize)
+    {
+        QuantizedStore qstore = QuantizedStore::encode(store, quantizeFormat);
+        cout << "\n\n== K-NN EM LINHAS " << rowFormatName(quantizeFormat) << " ("
+             << qstore.memoryBytes() / 1024 << " KB contra " << (size_t)store.size() * store.dims() * sizeof(float) / 1024
+             << " KB em float, erro max do chi2 = " << qstore.maxError() << ") ==\n";
+        QueryStats approxStats, exactStats, qtreeStats;
+        vector<Neighbor> approxKnn = searchKnnQuantized(qstore, imagesList, imageQuery, demoK, nullptr, &approxStats);
+        knnLine("Lista compacta", approxKnn, approxStats);
+        vector<Neighbor> exactKnn = searchKnnQuantized(qstore, imagesList, imageQuery, demoK, &store, &exactStats);
+        knnLine("Lista compacta + re-rank", exactKnn, exactStats);
+        QuantizedMTree qtree(qstore, mtreeParams);
+        qtree.build(imagesList);
+        vector<Neighbor> qtreeKnn = knnReranked(qtree, qstore, store, imageQuery, demoK, &qtreeStats);
+        knnLine("M-Tree compacta + re-rank", qtreeKnn, qtreeStats);
+    }
 
-    // M-TREE -----------------
-    auto m1 = Clock::now();
-    MTree mtree;
-    for (int i = 0; i < (int)imagesList.size(); i++)
-        mtree.insert(imagesList[i]);
-    auto m2 = Clock::now();
+    // linhas esparsas escolhidas pela densidade; as distâncias são as mesmas
+    if (sparse)
+    {
+        SparseStore sstore = SparseStore::encode(store);
+        cout << "\n\n== K-NN EM LINHAS ESPARSAS (" << sstore.sparseRows() << " de " << sstore.size()
+             << " esparsas com densidade <= " << sstore.maxDensity() << ", " << sstore.memoryBytes() / 1024
+             << " KB contra " << (size_t)store.size() * store.dims() * sizeof(float) / 1024 << " KB) ==\n";
+        QueryStats sparseStats, streeStats;
+        vector<Neighbor> sparseKnn = searchKnnSparse(sstore, imagesList, imageQuery, demoK, &sparseStats);
+        knnLine("Lista esparsa", sparseKnn, sparseStats);
+        SparseMTree stree(sstore, mtreeParams);
+        stree.build(imagesList);
+        vector<Neighbor> streeKnn = stree.knn(imageQuery, demoK, &streeStats);
+        knnLine("M-Tree esparsa", streeKnn, streeStats);
+    }
 
-    auto mb1 = Clock::now();
-    MTreeSearchResult mtreeRes2 = mtree.searchMostSimilar(imageQueryItem);
-    auto mb2 = Clock::now();
+    // cascata 8 -> 64 -> 512 bins: mesmos vizinhos, menos distâncias completas
+    if (coarse)
+    {
+        CoarsePyramid pyramid = CoarsePyramid::build(store);
+        cout << "\n\n== K-NN COM PIRAMIDE 8/64 BINS (" << pyramid.memoryBytes() / 1024 << " KB) ==\n";
+        QueryStats coarseStats, ctreeStats;
+        vector<Neighbor> coarseKnn = searchKnnCoarse(store, pyramid, imagesList, imageQuery, demoK, &coarseStats);
+        knnLine("Lista + piramide", coarseKnn, coarseStats);
+        CoarseFilter<MTree::distance_type> filter(pyramid, imageQuery);
+        vector<Neighbor> ctreeKnn = tree0.knnFiltered(imageQuery, demoK, filter, &ctreeStats);
+        knnLine("M-Tree + piramide", ctreeKnn, ctreeStats);
+    }
 
-    double mtBuild = ms(m1, m2);
-    double mtSearch = ms(mb1, mb2);
+    if (demoRadius >= 0.0f)
+    {
+        cout << "\n\n== RANGE M-TREE (r=" << demoRadius << ") ==\n";
+        QueryStats rangeStats;
+        vector<Neighbor> inRange = tree0.range(imageQuery, demoRadius, &rangeStats);
+        cout << "(" << rangeStats.distances << " distancias calculadas, " << rangeStats.avoided << " evitadas)\n";
+        printNeighbors(store, inRange);
+        recordQueryStats(rangeStats);
+    }
 
-    // RESULTADOS ----------------------
-    cout << "\n===== TEMPOS (ms) =====\n";
-    cout << "Lista:    build=" << listBuild << " | busca=" << listSearch << "\n";
-    cout << "Hash:     build=" << hashBuild << " | busca=" << hashSearch << "\n";
-    cout << "Quadtree: build+search=" << qtBuild_Total << " (Não Separado)\n";
-    cout << "M-Tree:   build=" << mtBuild << " | busca=" << mtSearch << "\n\n";
+    if (showStats)
+    {
+        cout << "\n\n== HISTOGRAMAS DAS CONSULTAS ==\n";
+        dumpQueryStats(cout);
+    }
 
+    // Tempos de construção/busca, latência, recall e memória: bench/bench_engines.cpp
     return 0;
 }
@@ -3,6 +3,16 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PAA_HAS_MMAP 1
+#endif
 
 struct ImageRGB8 {
     int width = 0, height = 0;
@@ -48,3 +58,98 @@ inline bool loadPPM_P6(const std::string& path, ImageRGB8& out) {
     f.read(reinterpret_cast<char*>(out.data.data()), out.data.size());
     return f.good();
 }
+
+// Lê um inteiro ASCII do cabeçalho em [p, end), pulando espaços e comentários
+inline bool ppm_parse_int(const unsigned char*& p, const unsigned char* end, int& value) {
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+        if (p < end && *p == '#') {
+            while (p < end && *p != '\n') ++p;
+            continue;
+        }
+        break;
+    }
+    if (p == end || *p < '0' || *p > '9') return false;
+    long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+        if (v > 1000000000LL) return false;
+    }
+    value = (int)v;
+    return true;
+}
+
+// PPM P6 mapeado em memória (somente leitura, sem cópia do raster).
+// pixels() aponta para width*height*3 bytes RGB dentro do mapeamento.
+class MappedPPM {
+public:
+    MappedPPM() = default;
+    MappedPPM(const MappedPPM&) = delete;
+    MappedPPM& operator=(const MappedPPM&) = delete;
+    ~MappedPPM() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef PAA_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) { ::close(fd); return false; }
+        size_ = (size_t)st.st_size;
+        void* m = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (m == MAP_FAILED) { size_ = 0; return false; }
+        base_ = static_cast<const unsigned char*>(m);
+        madvise(m, size_, MADV_SEQUENTIAL);
+
+        const unsigned char* p = base_;
+        const unsigned char* end = base_ + size_;
+        int maxv = 0;
+        if (size_ < 2 || p[0] != 'P' || p[1] != '6') {
+            std::cerr << "Apenas PPM P6 suportado.\n";
+            close(); return false;
+        }
+        p += 2;
+        if (!ppm_parse_int(p, end, width_) || !ppm_parse_int(p, end, height_) ||
+            !ppm_parse_int(p, end, maxv) || width_ <= 0 || height_ <= 0 || p == end) {
+            close(); return false;
+        }
+        if (maxv != 255) {
+            std::cerr << "Apenas maxval=255 suportado.\n";
+            close(); return false;
+        }
+        ++p; // um único whitespace após o cabeçalho
+
+        // arquivo truncado falha aqui, antes de qualquer leitura de pixel
+        uint64_t need = (uint64_t)width_ * (uint64_t)height_ * 3;
+        if ((uint64_t)(end - p) < need) {
+            std::cerr << "PPM truncado: " << path << " (" << (end - p) << " de " << need << " bytes)\n";
+            close(); return false;
+        }
+        pixels_ = p;
+        return true;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    void close() {
+#ifdef PAA_HAS_MMAP
+        if (base_) munmap(const_cast<unsigned char*>(base_), size_);
+#endif
+        base_ = pixels_ = nullptr;
+        size_ = 0; width_ = height_ = 0;
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    size_t pixelCount() const { return (size_t)width_ * height_; }
+    const unsigned char* pixels() const { return pixels_; }
+
+private:
+    const unsigned char* base_ = nullptr;
+    const unsigned char* pixels_ = nullptr;
+    size_t size_ = 0;
+    int width_ = 0, height_ = 0;
+};
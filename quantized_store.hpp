@@ -0,0 +1,576 @@
+// quantized_store.hpp — histogramas compactos (uint8 / uint16 / fp16) e qui-quadrado sobre eles
+#pragma once
+#include "feature_store.hpp"
+#include "distance_policy.hpp"
+#include "histogram.hpp"
+#include "query_stats.hpp"
+#include "search_mtree.hpp"
+#include "thread_pool.hpp"
+#include "top_k.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - Guarda as linhas do FeatureStore em um formato menor (mesmos números
+       de linha), para a matriz caber na memória dos nós de consulta:
+         U8   1 byte/bin  (512 B por linha)  código = round(h / s), s = max(h)/255
+         U16  2 bytes/bin (1 KB por linha)   código = round(h / s), s = max(h)/65535
+         F16  2 bytes/bin (1 KB por linha)   meia precisão IEEE, sem escala
+       Bins zerados continuam exatamente zero em todos os formatos.
+     - A consulta continua em float: o kernel decodifica a linha (SIMD, com
+       extensão dos inteiros / cvtph) e calcula chi2(linha, consulta) sem
+       materializar a linha em float.
+     - Limite de erro por linha: para a, b >= 0, |d/da (a-b)^2/(a+b)| =
+       |t (2 - t)| <= 3, com t = (a-b)/(a+b). Logo, com ĥ a linha decodificada,
+         |chi2(ĥ, q) - chi2(h, q)| <= E = 3 * soma_i |h_i - ĥ_i|
+       para qualquer consulta q. E é calculado na codificação e guardado por
+       linha (error(r)); maxError() é o maior deles. Ordem de grandeza em
+       histogramas reais: U16 ~1e-4, F16 ~1e-3, U8 ~1e-2 (um chi2 típico entre
+       vizinhos fica entre 0.05 e 0.5).
+     - Re-rank exato opcional: com E, as buscas compactas sabem exatamente quais
+       candidatos ainda podem estar no top-k e só esses são recalculados nas
+       linhas float (searchKnnQuantized / knnReranked).
+
+   API:
+     QuantizedStore q = QuantizedStore::encode(store, RowFormat::U8);
+     computeRGBHistogramQuantized(rgb, pixels, RowFormat::U8, codes, scale, error);
+     float d = q.chiSquare(row, query);
+     std::vector<Neighbor> v = searchKnnQuantized(q, index, query, k, &store); // exato
+     BasicMTree<SqrtChiSquareDistance, QuantizedStore> tree(q);              // M-Tree compacta
+     std::vector<Neighbor> w = knnReranked(tree, q, store, query, k);        // exato
+-----------------------------------------------------------------------------*/
+
+enum class RowFormat { U8, U16, F16 };
+
+inline const char* rowFormatName(RowFormat f) {
+    switch (f) {
+        case RowFormat::U8:  return "u8";
+        case RowFormat::U16: return "u16";
+        default:             return "f16";
+    }
+}
+
+inline bool parseRowFormat(const char* s, RowFormat& out) {
+    if (!std::strcmp(s, "u8"))       out = RowFormat::U8;
+    else if (!std::strcmp(s, "u16")) out = RowFormat::U16;
+    else if (!std::strcmp(s, "f16")) out = RowFormat::F16;
+    else return false;
+    return true;
+}
+
+inline size_t rowFormatBytes(RowFormat f) { return f == RowFormat::U8 ? 1 : 2; }
+
+// ---- meia precisão (IEEE 754 binary16), arredondamento ao par mais próximo --
+
+inline uint16_t floatToHalf(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, 4);
+    const uint32_t sign = (x >> 16) & 0x8000, abs = x & 0x7FFFFFFF;
+    if (abs >= 0x47800000)                        // >= 65536: inf (ou NaN)
+        return (uint16_t)(sign | (abs > 0x7F800000 ? 0x7E00 : 0x7C00));
+    if (abs < 0x38800000) {                       // < 2^-14: subnormal
+        float v;
+        std::memcpy(&v, &abs, 4);
+        return (uint16_t)(sign | (uint32_t)std::lrint(v * 16777216.0f));   // em unidades de 2^-24
+    }
+    uint32_t h = (abs - 0x38000000) >> 13;        // expoente 127 -> 15, mantissa 23 -> 10
+    const uint32_t rest = abs & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+    return (uint16_t)(sign | h);
+}
+
+inline float halfToFloat(uint16_t h) {
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16, exp = (h >> 10) & 0x1F, man = h & 0x3FF;
+    if (exp == 0) {
+        float v = man * (1.0f / 16777216.0f);
+        return sign ? -v : v;
+    }
+    uint32_t x = sign | (exp == 31 ? 0x7F800000 | (man << 13) : ((exp + 112) << 23) | (man << 13));
+    float f;
+    std::memcpy(&f, &x, 4);
+    return f;
+}
+
+// ---- kernels: chi2(linha codificada * escala, consulta float) --------------
+
+inline float chiSquareU8Scalar(const void* codes, float scale, const float* q, size_t n) {
+    const uint8_t* c = static_cast<const uint8_t*>(codes);
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        float a = c[i] * scale, denom = a + q[i];
+        if (denom != 0.0f) { float d = a - q[i]; sum += d * d / denom; }
+    }
+    return sum;
+}
+
+inline float chiSquareU16Scalar(const void* codes, float scale, const float* q, size_t n) {
+    const uint16_t* c = static_cast<const uint16_t*>(codes);
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        float a = c[i] * scale, denom = a + q[i];
+        if (denom != 0.0f) { float d = a - q[i]; sum += d * d / denom; }
+    }
+    return sum;
+}
+
+inline float chiSquareF16Scalar(const void* codes, float, const float* q, size_t n) {
+    const uint16_t* c = static_cast<const uint16_t*>(codes);
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        float a = halfToFloat(c[i]), denom = a + q[i];
+        if (denom != 0.0f) { float d = a - q[i]; sum += d * d / denom; }
+    }
+    return sum;
+}
+
+#ifdef PAA_X86_SIMD
+
+// Termo do qui-quadrado de 8 / 16 bins já decodificados (denominador zero mascarado)
+__attribute__((target("avx2,fma")))
+inline __m256 chiSquareTerm256(__m256 a, __m256 b, __m256 acc) {
+    __m256 d = _mm256_sub_ps(a, b), s = _mm256_add_ps(a, b);
+    __m256 m = _mm256_cmp_ps(s, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+    s = _mm256_blendv_ps(_mm256_set1_ps(1.0f), s, m);
+    return _mm256_add_ps(acc, _mm256_and_ps(m, _mm256_div_ps(_mm256_mul_ps(d, d), s)));
+}
+
+__attribute__((target("avx512f")))
+inline __m512 chiSquareTerm512(__m512 a, __m512 b, __m512 acc) {
+    __m512 d = _mm512_sub_ps(a, b), s = _mm512_add_ps(a, b);
+    __mmask16 m = _mm512_cmp_ps_mask(s, _mm512_setzero_ps(), _CMP_NEQ_OQ);
+    return _mm512_mask_add_ps(acc, m, acc, _mm512_maskz_div_ps(m, _mm512_mul_ps(d, d), s));
+}
+
+__attribute__((target("avx2,fma")))
+inline float chiSquareU8AVX2(const void* codes, float scale, const float* q, size_t n) {
+    const uint8_t* c = static_cast<const uint8_t*>(codes);
+    const __m256 vs = _mm256_set1_ps(scale);
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i raw = _mm_loadu_si128((const __m128i*)(c + i));
+        __m256 a0 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(raw)), vs);
+        __m256 a1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(raw, 8))), vs);
+        acc0 = chiSquareTerm256(a0, _mm256_loadu_ps(q + i), acc0);
+        acc1 = chiSquareTerm256(a1, _mm256_loadu_ps(q + i + 8), acc1);
+    }
+    return paaHsum256(_mm256_add_ps(acc0, acc1)) + chiSquareU8Scalar(c + i, scale, q + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline float chiSquareU16AVX2(const void* codes, float scale, const float* q, size_t n) {
+    const uint16_t* c = static_cast<const uint16_t*>(codes);
+    const __m256 vs = _mm256_set1_ps(scale);
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a0 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(c + i)))), vs);
+        __m256 a1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(c + i + 8)))), vs);
+        acc0 = chiSquareTerm256(a0, _mm256_loadu_ps(q + i), acc0);
+        acc1 = chiSquareTerm256(a1, _mm256_loadu_ps(q + i + 8), acc1);
+    }
+    return paaHsum256(_mm256_add_ps(acc0, acc1)) + chiSquareU16Scalar(c + i, scale, q + i, n - i);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+inline float chiSquareF16AVX2(const void* codes, float scale, const float* q, size_t n) {
+    const uint16_t* c = static_cast<const uint16_t*>(codes);
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a0 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(c + i)));
+        __m256 a1 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(c + i + 8)));
+        acc0 = chiSquareTerm256(a0, _mm256_loadu_ps(q + i), acc0);
+        acc1 = chiSquareTerm256(a1, _mm256_loadu_ps(q + i + 8), acc1);
+    }
+    return paaHsum256(_mm256_add_ps(acc0, acc1)) + chiSquareF16Scalar(c + i, scale, q + i, n - i);
+}
+
+// Conversões de 16 códigos para float. As variantes maskz com máscara cheia
+// evitam o falso -Wmaybe-uninitialized dos cabeçalhos do GCC 12 nas versões sem máscara.
+__attribute__((target("avx512f")))
+inline __m512 u8ToFloat512(__m128i c) {
+    return _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(0xFFFF, c));
+}
+
+__attribute__((target("avx512f")))
+inline __m512 u16ToFloat512(__m256i c) {
+    return _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu16_epi32(0xFFFF, c));
+}
+
+__attribute__((target("avx512f")))
+inline __m512 halfToFloat512(__m256i c) { return _mm512_maskz_cvtph_ps(0xFFFF, c); }
+
+__attribute__((target("avx512f")))
+inline float chiSquareU8AVX512(const void* codes, float scale, const float* q, size_t n) {
+    const uint8_t* c = static_cast<const uint8_t*>(codes);
+    const __m512 vs = _mm512_set1_ps(scale);
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 a0 = _mm512_mul_ps(u8ToFloat512(_mm_loadu_si128((const __m128i*)(c + i))), vs);
+        __m512 a1 = _mm512_mul_ps(u8ToFloat512(_mm_loadu_si128((const __m128i*)(c + i + 16))), vs);
+        acc0 = chiSquareTerm512(a0, _mm512_loadu_ps(q + i), acc0);
+        acc1 = chiSquareTerm512(a1, _mm512_loadu_ps(q + i + 16), acc1);
+    }
+    return paaHsum512(_mm512_add_ps(acc0, acc1)) + chiSquareU8Scalar(c + i, scale, q + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline float chiSquareU16AVX512(const void* codes, float scale, const float* q, size_t n) {
+    const uint16_t* c = static_cast<const uint16_t*>(codes);
+    const __m512 vs = _mm512_set1_ps(scale);
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 a0 = _mm512_mul_ps(u16ToFloat512(_mm256_loadu_si256((const __m256i*)(c + i))), vs);
+        __m512 a1 = _mm512_mul_ps(u16ToFloat512(_mm256_loadu_si256((const __m256i*)(c + i + 16))), vs);
+        acc0 = chiSquareTerm512(a0, _mm512_loadu_ps(q + i), acc0);
+        acc1 = chiSquareTerm512(a1, _mm512_loadu_ps(q + i + 16), acc1);
+    }
+    return paaHsum512(_mm512_add_ps(acc0, acc1)) + chiSquareU16Scalar(c + i, scale, q + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline float chiSquareF16AVX512(const void* codes, float scale, const float* q, size_t n) {
+    const uint16_t* c = static_cast<const uint16_t*>(codes);
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 a0 = halfToFloat512(_mm256_loadu_si256((const __m256i*)(c + i)));
+        __m512 a1 = halfToFloat512(_mm256_loadu_si256((const __m256i*)(c + i + 16)));
+        acc0 = chiSquareTerm512(a0, _mm512_loadu_ps(q + i), acc0);
+        acc1 = chiSquareTerm512(a1, _mm512_loadu_ps(q + i + 16), acc1);
+    }
+    return paaHsum512(_mm512_add_ps(acc0, acc1)) + chiSquareF16Scalar(c + i, scale, q + i, n - i);
+}
+
+#endif // PAA_X86_SIMD
+
+using QuantizedChiSquareFn = float (*)(const void*, float, const float*, size_t);
+
+// Kernel de um formato e ISA (SSE não tem versão própria: usa o scalar)
+inline QuantizedChiSquareFn quantizedChiSquareKernel(RowFormat format, DistanceIsa isa) {
+#ifdef PAA_X86_SIMD
+    if (isa == DistanceIsa::AVX512) {
+        switch (format) {
+            case RowFormat::U8:  return chiSquareU8AVX512;
+            case RowFormat::U16: return chiSquareU16AVX512;
+            default:             return chiSquareF16AVX512;
+        }
+    }
+    if (isa == DistanceIsa::AVX2 && (format != RowFormat::F16 || __builtin_cpu_supports("f16c"))) {
+        switch (format) {
+            case RowFormat::U8:  return chiSquareU8AVX2;
+            case RowFormat::U16: return chiSquareU16AVX2;
+            default:             return chiSquareF16AVX2;
+        }
+    }
+#else
+    (void)isa;
+#endif
+    switch (format) {
+        case RowFormat::U8:  return chiSquareU8Scalar;
+        case RowFormat::U16: return chiSquareU16Scalar;
+        default:             return chiSquareF16Scalar;
+    }
+}
+
+// ---- codificação ---------------------------------------------------------
+
+// Codifica um histograma float; scale multiplica o código (1 em F16) e
+// error recebe o limite E = 3 * soma |h - ĥ| do erro do qui-quadrado
+inline void quantizeRow(const float* h, size_t dims, RowFormat format, void* out, float& scale, float& error) {
+    float l1 = 0.0f;
+    if (format == RowFormat::F16) {
+        uint16_t* c = static_cast<uint16_t*>(out);
+        for (size_t i = 0; i < dims; i++) {
+            c[i] = floatToHalf(h[i]);
+            l1 += std::fabs(h[i] - halfToFloat(c[i]));
+        }
+        scale = 1.0f;
+    } else {
+        const float qmax = format == RowFormat::U8 ? 255.0f : 65535.0f;
+        float peak = 0.0f;
+        for (size_t i = 0; i < dims; i++) peak = std::max(peak, h[i]);
+        scale = peak > 0.0f ? peak / qmax : 1.0f;
+        const float inv = 1.0f / scale;
+        for (size_t i = 0; i < dims; i++) {
+            float code = std::min(qmax, std::nearbyint(h[i] * inv));
+            if (format == RowFormat::U8) static_cast<uint8_t*>(out)[i] = (uint8_t)code;
+            else static_cast<uint16_t*>(out)[i] = (uint16_t)code;
+            l1 += std::fabs(h[i] - code * scale);
+        }
+    }
+    // folga para o arredondamento dos dois kernels em float
+    error = 3.0f * l1 * 1.001f + 1e-6f;
+}
+
+// Variante do computeRGBHistogram que já entrega a linha compacta
+inline void computeRGBHistogramQuantized(const unsigned char* rgb, size_t pixels, RowFormat format,
+                                         void* out, float& scale, float& error) {
+    alignas(64) float hist[kHistSize];
+    computeRGBHistogram(rgb, pixels, hist);
+    quantizeRow(hist, kHistSize, format, out, scale, error);
+}
+
+// ---- store ---------------------------------------------------------------
+
+class QuantizedStore {
+public:
+    explicit QuantizedStore(RowFormat format = RowFormat::U8, size_t dims = FeatureStore::kDims)
+        : format_(format), dims_(dims),
+          stride_((dims * rowFormatBytes(format) + FeatureStore::kAlign - 1) / FeatureStore::kAlign * FeatureStore::kAlign),
+          kernel_(quantizedChiSquareKernel(format, detectDistanceIsa())) {}
+
+    // Todas as linhas do store, na mesma numeração (em paralelo se houver pool)
+    static QuantizedStore encode(const FeatureStore& store, RowFormat format, ThreadPool* pool = nullptr) {
+        QuantizedStore q(format, store.dims());
+        q.resize(store.size());
+        auto work = [&](int, size_t b, size_t e) {
+            for (size_t r = b; r < e; r++)
+                quantizeRow(store.row((uint32_t)r), q.dims_, format, q.mutableCodes(r), q.scales_[r], q.errors_[r]);
+        };
+        if (pool) pool->parallelFor(0, store.size(), work);
+        else work(0, 0, store.size());
+        q.refreshMaxError();
+        return q;
+    }
+
+    // Acrescenta uma linha já codificada (ex.: computeRGBHistogramQuantized)
+    uint32_t addCodes(const void* codes, float scale, float error) {
+        uint32_t r = rows_;
+        resize(rows_ + 1);
+        std::memcpy(mutableCodes(r), codes, dims_ * rowFormatBytes(format_));
+        scales_[r] = scale;
+        errors_[r] = error;
+        maxError_ = std::max(maxError_, error);
+        return r;
+    }
+
+    uint32_t add(const float* hist) {
+        uint32_t r = rows_;
+        resize(rows_ + 1);
+        quantizeRow(hist, dims_, format_, mutableCodes(r), scales_[r], errors_[r]);
+        maxError_ = std::max(maxError_, errors_[r]);
+        return r;
+    }
+
+    RowFormat format() const { return format_; }
+    uint32_t size() const { return rows_; }
+    size_t dims() const { return dims_; }
+    float scale(uint32_t r) const { return scales_[r]; }
+    float error(uint32_t r) const { return errors_[r]; }
+    float maxError() const { return maxError_; }
+
+    // Bytes ocupados (códigos + escala e erro por linha)
+    size_t memoryBytes() const { return (size_t)capacity_ * stride_ + scales_.capacity() * 2 * sizeof(float); }
+
+    const void* codes(size_t r) const { return data_.get() + r * stride_; }
+
+    float chiSquare(uint32_t r, const float* query) const { return kernel_(codes(r), scales_[r], query, dims_); }
+
+    void decode(uint32_t r, float* out) const {
+        if (format_ == RowFormat::F16) {
+            const uint16_t* c = static_cast<const uint16_t*>(codes(r));
+            for (size_t i = 0; i < dims_; i++) out[i] = halfToFloat(c[i]);
+        } else if (format_ == RowFormat::U8) {
+            const uint8_t* c = static_cast<const uint8_t*>(codes(r));
+            for (size_t i = 0; i < dims_; i++) out[i] = c[i] * scales_[r];
+        } else {
+            const uint16_t* c = static_cast<const uint16_t*>(codes(r));
+            for (size_t i = 0; i < dims_; i++) out[i] = c[i] * scales_[r];
+        }
+    }
+
+private:
+    void* mutableCodes(size_t r) { return data_.get() + r * stride_; }
+
+    void resize(uint32_t rows) {
+        if (rows > capacity_) {
+            uint32_t cap = std::max<uint32_t>(rows, capacity_ ? capacity_ * 2 : 64);
+            unsigned char* fresh = static_cast<unsigned char*>(std::aligned_alloc(FeatureStore::kAlign, (size_t)cap * stride_));
+            if (!fresh) throw std::bad_alloc();
+            if (rows_) std::memcpy(fresh, data_.get(), (size_t)rows_ * stride_);
+            data_.reset(fresh);
+            capacity_ = cap;
+        }
+        rows_ = rows;
+        scales_.resize(rows);
+        errors_.resize(rows);
+    }
+
+    void refreshMaxError() {
+        maxError_ = 0.0f;
+        for (float e : errors_) maxError_ = std::max(maxError_, e);
+    }
+
+    struct FreeDeleter { void operator()(unsigned char* p) const { std::free(p); } };
+
+    RowFormat format_;
+    size_t dims_;
+    size_t stride_;                 // bytes por linha, múltiplo de 64
+    QuantizedChiSquareFn kernel_;
+    uint32_t rows_ = 0, capacity_ = 0;
+    std::unique_ptr<unsigned char, FreeDeleter> data_;
+    std::vector<float> scales_, errors_;
+    float maxError_ = 0.0f;
+};
+
+// ---- M-Tree sobre linhas compactas (ver rowDistance em search_mtree.hpp) ---
+
+// Só o qui-quadrado e a sua raiz têm kernel compacto; outras políticas decodificam
+template <class Distance>
+inline float rowDistance(const QuantizedStore& store, uint32_t a, const float* b) {
+    if constexpr (std::is_same_v<Distance, ChiSquareDistance>) {
+        return store.chiSquare(a, b);
+    } else if constexpr (std::is_same_v<Distance, SqrtChiSquareDistance>) {
+        return std::sqrt(store.chiSquare(a, b));
+    } else {
+        thread_local std::vector<float> buf;
+        buf.resize(store.dims());
+        store.decode(a, buf.data());
+        return Distance::eval(buf.data(), b, store.dims());
+    }
+}
+
+template <class Distance>
+inline float rowDistance(const QuantizedStore& store, uint32_t a, uint32_t b) {
+    thread_local std::vector<float> other;
+    other.resize(store.dims());
+    store.decode(b, other.data());
+    return rowDistance<Distance>(store, a, other.data());
+}
+
+inline const float* rowVector(const QuantizedStore& store, uint32_t r, float* buf) {
+    store.decode(r, buf);
+    return buf;
+}
+
+using QuantizedMTree = BasicMTree<SqrtChiSquareDistance, QuantizedStore>;
+
+// ---- buscas com re-rank exato --------------------------------------------
+
+// Re-rank: chi2 exato (linhas float) dos candidatos cujo limite inferior
+// (distância compacta - E) ainda não passa da k-ésima distância exata
+// garantida; o resultado é o mesmo top-k da busca float.
+inline std::vector<Neighbor> rerankExact(const FeatureStore& exact, const std::vector<Neighbor>& candidates,
+                                         const QuantizedStore& q, const float* query, size_t k,
+                                         QueryStats* stats) {
+    QueryTimer timer(stats, QueryPhase::Rerank);
+    BoundedTopK<float> best(k);
+    if (k == 0) return best.sorted();
+
+    // teto da k-ésima distância: k candidatos com o menor limite superior
+    BoundedTopK<float> upper(k);
+    for (const Neighbor& c : candidates) upper.push(c.row, c.distance + q.error(c.row));
+    const float ceiling = upper.full() ? upper.worst() : std::numeric_limits<float>::infinity();
+
+    size_t reranked = 0;
+    for (const Neighbor& c : candidates) {
+        if (c.distance - q.error(c.row) > ceiling) continue;
+        if (best.full() && c.distance - q.error(c.row) > best.worst()) continue;
+        best.push(c.row, chiSquareDist(exact.row(c.row), query, exact.dims()));
+        reranked++;
+    }
+    statAdd(stats, &QueryStats::reranked, reranked);
+    statAdd(stats, &QueryStats::distances, reranked);
+    return best.sorted();
+}
+
+// k-NN na lista sobre linhas compactas (qui-quadrado). Sem exact: ordem pela
+// distância compacta (aproximada, erro <= E por linha). Com exact: o top-k
+// exato, recalculando nas linhas float só os candidatos que o limite de erro
+// não consegue descartar.
+inline std::vector<Neighbor> searchKnnQuantized(const QuantizedStore& q, const std::vector<uint32_t>& index,
+                                                const float* query, size_t k,
+                                                const FeatureStore* exact = nullptr, QueryStats* stats = nullptr) {
+    QueryTimer timer(stats, QueryPhase::Total);
+    statAdd(stats, &QueryStats::distances, index.size());
+    if (!exact || k == 0) {
+        BoundedTopK<float> best(k);
+        for (uint32_t row : index) best.push(row, q.chiSquare(row, query));
+        return best.sorted();
+    }
+
+    // Uma passada com heap limitado: o teto da k-ésima distância exata (k
+    // menores d + E) só desce, então quem já tem d - E acima dele nunca será
+    // re-ranqueado. A lista é limpa a cada vez que dobra; só os
+    // sobreviventes (~k mais os empatados dentro do erro) são ordenados.
+    std::vector<Neighbor> kept;
+    {
+        QueryTimer probe(stats, QueryPhase::Probe);
+        BoundedTopK<float> upper(k);
+        size_t cleanAt = 2 * k + 64;
+        for (uint32_t row : index) {
+            const float d = q.chiSquare(row, query), e = q.error(row);
+            upper.push(row, d + e);
+            if (d - e > upper.worst()) continue;
+            kept.push_back({row, d});
+            if (kept.size() >= cleanAt) {
+                const float ceiling = upper.worst();
+                kept.erase(std::remove_if(kept.begin(), kept.end(), [&](const Neighbor& c) {
+                    return c.distance - q.error(c.row) > ceiling;
+                }), kept.end());
+                cleanAt = std::max(cleanAt, 2 * kept.size());
+            }
+        }
+    }
+    // ordem crescente da distância compacta: o re-rank para cedo
+    std::sort(kept.begin(), kept.end(), [](const Neighbor& a, const Neighbor& b) {
+        return a.distance < b.distance || (a.distance == b.distance && a.row < b.row);
+    });
+    statAdd(stats, &QueryStats::candidates, kept.size());
+    return rerankExact(*exact, kept, q, query, k, stats);
+}
+
+// Coletor do knnReranked: re-rank exato durante o próprio percurso da árvore.
+// Um item com chi2 exato <= t (k-ésimo exato atual) tem chi2 compacto
+// <= t + E_max, então o raio de poda é sqrt(t + E_max) e diminui com t.
+struct QuantizedRerankCollector {
+    const QuantizedStore& q;
+    const FeatureStore& exact;
+    const float* query;
+    BoundedTopK<float> best;   // chi2 exato
+    size_t offered = 0, reranked = 0;
+
+    float bound() const {
+        // folga pequena: a raiz e a soma em float arredondam perto da borda
+        return best.full() ? std::sqrt((best.worst() + q.maxError()) * 1.0001f + 1e-6f)
+                           : std::numeric_limits<float>::infinity();
+    }
+    bool rejects(uint32_t, QueryStats*) const { return false; }
+    void offer(uint32_t row, float d) {   // d = sqrt(chi2 compacto)
+        offered++;
+        if (best.full() && d * d - q.error(row) > best.worst()) return;
+        best.push(row, chiSquareDist(exact.row(row), query, exact.dims()));
+        reranked++;
+    }
+};
+
+// k-NN exato (distâncias em chi2) com a M-Tree compacta, em um só percurso:
+// o best-first da árvore leva o raio do coletor acima e cada objeto de folha
+// que o limite d^2 - E não descarta é recalculado na linha float
+template <class Distance>
+inline std::vector<Neighbor> knnReranked(const BasicMTree<Distance, QuantizedStore>& tree, const QuantizedStore& q,
+                                         const FeatureStore& exact, const float* query, size_t k,
+                                         QueryStats* stats = nullptr) {
+    static_assert(std::is_same_v<Distance, SqrtChiSquareDistance>, "re-rank exato definido para sqrt(chi2)");
+    QueryTimer timer(stats, QueryPhase::Total);
+    QuantizedRerankCollector c{q, exact, query, BoundedTopK<float>(k)};
+    if (k > 0) tree.bestFirst(query, c, stats);
+    statAdd(stats, &QueryStats::candidates, c.offered);
+    statAdd(stats, &QueryStats::reranked, c.reranked);
+    statAdd(stats, &QueryStats::distances, c.reranked);
+    return c.best.sorted();
+}
@@ -0,0 +1,252 @@
+// query_stats.hpp — custo de cada consulta e agregação por thread
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - Toda busca aceita um QueryStats* opcional (nullptr = não conta nada) e
+       soma nele o que a consulta custou: distâncias exatas, itens descartados
+       só pelo limite inferior, nós/buckets visitados, subárvores podadas,
+       candidatos, re-ranqueados, descartes da pirâmide grossa e o tempo de
+       cada fase.
+     - Compilado com -DPAA_QUERY_STATS=0, statAdd e QueryTimer viram código
+       vazio e as buscas não pagam nada, nem o teste do ponteiro.
+     - recordQueryStats() acumula a consulta nos contadores da thread atual
+       (um slot por thread, só ela escreve: sem trava no caminho da consulta);
+       dumpQueryStats() soma os slots e imprime um histograma log2 por métrica.
+
+   API:
+     statAdd(stats, &QueryStats::distances);          // +1 (ou +n)
+     QueryTimer t(stats, QueryPhase::Total);          // tempo até o fim do escopo
+     recordQueryStats(stats);
+     dumpQueryStats(std::cout);
+     resetQueryStats();
+-----------------------------------------------------------------------------*/
+
+#ifndef PAA_QUERY_STATS
+#define PAA_QUERY_STATS 1
+#endif
+
+static constexpr bool kQueryStatsEnabled = PAA_QUERY_STATS != 0;
+
+// Fases com tempo próprio: Probe = gerar candidatos antes das distâncias exatas
+// (buckets do hash, passada nas linhas compactas), Rerank = distâncias exatas
+// desses candidatos, Total = consulta inteira. Lista e árvores calculam as
+// distâncias durante a própria descida: só registram Total.
+enum class QueryPhase { Probe, Rerank, Total };
+static constexpr size_t kQueryPhases = 3;
+
+inline const char* queryPhaseName(QueryPhase p) {
+    switch (p) {
+        case QueryPhase::Probe:  return "probe";
+        case QueryPhase::Rerank: return "rerank";
+        default:                 return "total";
+    }
+}
+
+struct QueryStats
+{
+    uint64_t distances = 0;       // distâncias exatas calculadas
+    uint64_t avoided = 0;         // itens descartados só pelo limite inferior
+    uint64_t nodesVisited = 0;    // nós abertos (árvores) ou buckets lidos (hash)
+    uint64_t subtreesPruned = 0;  // filhos/quadrantes nunca abertos
+    uint64_t candidates = 0;      // candidatos gerados (hash)
+    uint64_t reranked = 0;        // candidatos com distância exata (hash)
+    uint64_t rejected8 = 0;       // descartados pelo limite de 8 bins (coarse_filter.hpp)
+    uint64_t rejected64 = 0;      // descartados pelo limite de 64 bins
+    uint64_t phaseNanos[kQueryPhases] = {};
+
+    uint64_t nanos(QueryPhase p) const { return phaseNanos[(size_t)p]; }
+
+    QueryStats& operator+=(const QueryStats& o) {
+        distances += o.distances; avoided += o.avoided; nodesVisited += o.nodesVisited;
+        subtreesPruned += o.subtreesPruned; candidates += o.candidates; reranked += o.reranked;
+        rejected8 += o.rejected8; rejected64 += o.rejected64;
+        for (size_t p = 0; p < kQueryPhases; p++) phaseNanos[p] += o.phaseNanos[p];
+        return *this;
+    }
+};
+
+// Soma n ao contador, se houver onde contar
+inline void statAdd(QueryStats* stats, uint64_t QueryStats::*field, uint64_t n = 1) {
+    if constexpr (kQueryStatsEnabled) {
+        if (stats) stats->*field += n;
+    } else {
+        (void)stats; (void)field; (void)n;
+    }
+}
+
+// Cronômetro de uma fase (RAII): soma o tempo do escopo em stats->phaseNanos
+class QueryTimer {
+public:
+    QueryTimer(QueryStats* stats, QueryPhase phase) {
+        if constexpr (kQueryStatsEnabled) {
+            if (stats) {
+                target_ = &stats->phaseNanos[(size_t)phase];
+                start_ = std::chrono::steady_clock::now();
+            }
+        } else {
+            (void)stats; (void)phase;
+        }
+    }
+    ~QueryTimer() {
+        if constexpr (kQueryStatsEnabled) {
+            if (target_)
+                *target_ += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start_).count();
+        }
+    }
+    QueryTimer(const QueryTimer&) = delete;
+    QueryTimer& operator=(const QueryTimer&) = delete;
+
+private:
+    uint64_t* target_ = nullptr;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// ---- agregação por thread --------------------------------------------------
+
+// Métricas dos histogramas: os oito contadores e o tempo de cada fase
+static constexpr size_t kQueryMetrics = 8 + kQueryPhases;
+static constexpr size_t kQueryBuckets = 48;   // bucket b: valores em [2^(b-1), 2^b)
+
+inline const char* queryMetricName(size_t m) {
+    static const char* names[kQueryMetrics] = {
+        "distances", "avoided", "nodes_visited", "subtrees_pruned", "candidates", "reranked",
+        "rejected_8", "rejected_64", "probe_ns", "rerank_ns", "total_ns"};
+    return names[m];
+}
+
+inline void queryMetricValues(const QueryStats& s, uint64_t out[kQueryMetrics]) {
+    const uint64_t v[kQueryMetrics] = {s.distances, s.avoided, s.nodesVisited, s.subtreesPruned,
+                                       s.candidates, s.reranked, s.rejected8, s.rejected64,
+                                       s.phaseNanos[0], s.phaseNanos[1], s.phaseNanos[2]};
+    for (size_t m = 0; m < kQueryMetrics; m++) out[m] = v[m];
+}
+
+inline size_t queryBucket(uint64_t v) {
+    size_t b = 0;
+    while (v) { b++; v >>= 1; }
+    return b < kQueryBuckets ? b : kQueryBuckets - 1;
+}
+
+// Contadores de uma thread; só a dona escreve (relaxed), o dump só lê
+struct QueryStatsSlot
+{
+    std::atomic<uint64_t> queries{0};
+    std::atomic<uint64_t> sum[kQueryMetrics] = {};
+    std::atomic<uint64_t> hist[kQueryMetrics][kQueryBuckets] = {};
+};
+
+class QueryStatsRegistry {
+public:
+    static QueryStatsRegistry& global() {
+        static QueryStatsRegistry registry;
+        return registry;
+    }
+
+    // Slot da thread atual (criado no primeiro uso; sobrevive à thread)
+    QueryStatsSlot& local() {
+        thread_local QueryStatsSlot* slot = nullptr;
+        if (!slot) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slots_.push_back(std::make_unique<QueryStatsSlot>());
+            slot = slots_.back().get();
+        }
+        return *slot;
+    }
+
+    void record(const QueryStats& s) {
+        QueryStatsSlot& slot = local();
+        uint64_t v[kQueryMetrics];
+        queryMetricValues(s, v);
+        slot.queries.fetch_add(1, std::memory_order_relaxed);
+        for (size_t m = 0; m < kQueryMetrics; m++) {
+            slot.sum[m].fetch_add(v[m], std::memory_order_relaxed);
+            slot.hist[m][queryBucket(v[m])].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Soma de todas as threads
+    void merge(uint64_t& queries, uint64_t sum[kQueryMetrics], uint64_t hist[kQueryMetrics][kQueryBuckets]) const {
+        queries = 0;
+        for (size_t m = 0; m < kQueryMetrics; m++) {
+            sum[m] = 0;
+            for (size_t b = 0; b < kQueryBuckets; b++) hist[m][b] = 0;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& slot : slots_) {
+            queries += slot->queries.load(std::memory_order_relaxed);
+            for (size_t m = 0; m < kQueryMetrics; m++) {
+                sum[m] += slot->sum[m].load(std::memory_order_relaxed);
+                for (size_t b = 0; b < kQueryBuckets; b++)
+                    hist[m][b] += slot->hist[m][b].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& slot : slots_) {
+            slot->queries.store(0, std::memory_order_relaxed);
+            for (size_t m = 0; m < kQueryMetrics; m++) {
+                slot->sum[m].store(0, std::memory_order_relaxed);
+                for (size_t b = 0; b < kQueryBuckets; b++) slot->hist[m][b].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    mutable std::mutex mutex_;   // só protege a lista de slots
+    std::vector<std::unique_ptr<QueryStatsSlot>> slots_;
+};
+
+inline void recordQueryStats(const QueryStats& stats) {
+    if constexpr (kQueryStatsEnabled) QueryStatsRegistry::global().record(stats);
+    else (void)stats;
+}
+
+inline void resetQueryStats() { QueryStatsRegistry::global().reset(); }
+
+// Uma linha por métrica: consultas, média e contagem por bucket log2 não vazio
+// ("[lo,hi):n"), fácil de ler e de processar
+inline void dumpQueryStats(std::ostream& out) {
+    uint64_t queries, sum[kQueryMetrics], hist[kQueryMetrics][kQueryBuckets];
+    QueryStatsRegistry::global().merge(queries, sum, hist);
+    out << "consultas=" << queries << "\n";
+    if (queries == 0) return;
+    for (size_t m = 0; m < kQueryMetrics; m++) {
+        out << queryMetricName(m) << " media=" << (double)sum[m] / queries;
+        for (size_t b = 0; b < kQueryBuckets; b++) {
+            if (!hist[m][b]) continue;
+            uint64_t lo = b ? 1ULL << (b - 1) : 0, hi = 1ULL << b;
+            out << " [" << lo << "," << hi << "):" << hist[m][b];
+        }
+        out << "\n";
+    }
+}
+
+// Fração dos candidatos que chegaram ao filtro grosso e foram descartados
+// sem a distância exata (na M-Tree as distâncias incluem as dos pivôs)
+inline double coarseRejectionRate(const QueryStats& s) {
+    uint64_t rejected = s.rejected8 + s.rejected64;
+    return rejected ? (double)rejected / (rejected + s.distances) : 0.0;
+}
+
+// Resumo de uma consulta em uma linha
+inline void printQueryStats(std::ostream& out, const QueryStats& s) {
+    out << "(" << s.distances << " distancias, " << s.avoided << " evitadas, "
+        << s.nodesVisited << " nos/buckets, " << s.subtreesPruned << " podados";
+    if (s.candidates) out << ", " << s.candidates << " candidatos, " << s.reranked << " re-ranqueados";
+    if (s.rejected8 || s.rejected64)
+        out << ", " << s.rejected8 << "+" << s.rejected64 << " rejeitados em 8/64 bins ("
+            << 100.0 * coarseRejectionRate(s) << "%)";
+    out << ", " << s.nanos(QueryPhase::Total) / 1000.0 << " us)\n";
+}
@@ -1,4 +1,4 @@
-// search_hash.hpp  — busca por hash via SimHash 128 bits para ImageItem (id + histogram)
+// search_hash.hpp  — busca por hash via SimHash 128 bits sobre as linhas do FeatureStore
 #pragma once
 #include <vector>
 #include <string>
@@ -6,24 +6,38 @@
 #include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <cmath>
+#include <stdexcept>
 
-#include "image_item.hpp"   // Usa a ImageItem do projeto (id, histogram)
+#include "feature_store.hpp" // Histogramas referenciados por linha
+#include "top_k.hpp"
+#include "query_stats.hpp"
+#include "distance_policy.hpp" // distância exata do re-rank e detecção de ISA
 
 /* -----------------------------------------------------------------------------
    O que faz:
-     - Constrói um SimHash de 128 bits a partir de ImageItem::histogram (std::vector<float>).
+     - Constrói um SimHash de 128 bits a partir de cada linha do FeatureStore
+       (matriz de sinais 512 x 128 pré-calculada; sh_simhash128_batch assina
+       vários histogramas por passada).
      - Compara hashes via distância de Hamming.
-     - Retorna top-K itens mais similares.
+     - Retorna top-K itens mais similares (com o qui-quadrado exato de cada um).
 
    API:
-     HashSearchResult searchMostSimilarHash(const std::vector<ImageItem>& base,
-                                            const ImageItem& query,
-                                            int topK = 3);
-
-   Observação:
-     - Este header pressupõe que ImageItem possui:
-         std::string id;
-         std::vector<float> histogram;
+     SimHashIndex index(store, params); index.build(rows);   // ver abaixo
+     HashSearchResult r = index.search(query, topK);           // só Hamming
+     HashSearchResult r = index.searchReranked(query, topK, rerank);
+                          // Hamming filtra "rerank" candidatos, qui-quadrado ordena
+     std::vector<Neighbor> v = index.knn(query, k, rerank);   // mesmo, como vizinhos
+     auto all = index.searchBatch(queries, k, rerank);         // várias consultas
+     (todas aceitam um QueryStats* opcional no fim: buckets, candidatos, re-rank)
+
+     HashSearchResult searchMostSimilarHash(const FeatureStore& store,
+                                            const std::vector<uint32_t>& base,
+                                            const float* query,
+                                            int topK = 3,
+                                            const Hash128* signatures = nullptr);
+     - signatures (opcional): assinaturas pré-calculadas indexadas pela linha
+       do store (ex.: seção SIGN do arquivo de índice).
 -----------------------------------------------------------------------------*/
 
 // ===== utilidades para SimHash deterministicamente =====
@@ -49,64 +63,543 @@ static inline int sh_hamming128(const Hash128& a, const Hash128& b) {
 #endif
 }
 
-static inline Hash128 sh_simhash128_from_hist(const std::vector<float>& hist) {
-    // 128 acumuladores (um “hiperplano” por bit)
-    double acc[128] = {0.0};
-    const size_t D = hist.size();
+// ===== matriz de projeção pré-calculada =====
+// Os sinais sh_rand_sign_for_dim_bit(d, b) são gerados uma única vez (na primeira
+// chamada) em uma matriz D x 128 de floats ±1: a linha d tem os sinais dos 128
+// hiperplanos, contígua e alinhada. A projeção vira acc += w[d] * sinal[d][:],
+// que os kernels AVX2/AVX-512 fazem com FMA; dimensões nulas são puladas.
+static constexpr size_t kSimHashMaxDims = 512;
+
+struct SimHashProjection {
+    alignas(64) float sign[kSimHashMaxDims][128];
+
+    SimHashProjection() {
+        for (size_t d = 0; d < kSimHashMaxDims; ++d)
+            for (int b = 0; b < 128; ++b)
+                sign[d][b] = sh_rand_sign_for_dim_bit((uint64_t)d, (uint64_t)b);
+    }
+};
+
+static inline const SimHashProjection& sh_projection() {
+    static const SimHashProjection projection;
+    return projection;
+}
+
+// Projeta "count" histogramas (1..4) de uma vez: cada linha de sinais é lida
+// uma vez por bloco. acc[j][b] = <hists[j], sinais do hiperplano b>
+static inline void sh_project_scalar(const float* const* hists, int count, size_t D, float (*acc)[128]) {
+    const SimHashProjection& P = sh_projection();
+    for (int j = 0; j < count; ++j)
+        for (int b = 0; b < 128; ++b) acc[j][b] = 0.0f;
     for (size_t d = 0; d < D; ++d) {
-        const double w = (double)hist[d];
-        if (w == 0.0) continue;
-        for (int b = 0; b < 128; ++b) {
-            acc[b] += (double)sh_rand_sign_for_dim_bit((uint64_t)d, (uint64_t)b) * w;
+        for (int j = 0; j < count; ++j) {
+            const float w = hists[j][d];
+            if (w == 0.0f) continue;
+            if (d < kSimHashMaxDims) {
+                for (int b = 0; b < 128; ++b) acc[j][b] += P.sign[d][b] * w;
+            } else {
+                for (int b = 0; b < 128; ++b)
+                    acc[j][b] += sh_rand_sign_for_dim_bit((uint64_t)d, (uint64_t)b) * w;
+            }
         }
     }
+}
+
+#ifdef PAA_X86_SIMD
+__attribute__((target("avx2,fma")))
+inline void sh_project_avx2(const float* const* hists, int count, size_t D, float (*acc)[128]) {
+    const SimHashProjection& P = sh_projection();
+    for (int j = 0; j < count; ++j)
+        for (int b = 0; b < 128; b += 8) _mm256_storeu_ps(acc[j] + b, _mm256_setzero_ps());
+    for (size_t d = 0; d < D; ++d) {
+        const float* s = P.sign[d];
+        for (int j = 0; j < count; ++j) {
+            const float w = hists[j][d];
+            if (w == 0.0f) continue;
+            const __m256 vw = _mm256_set1_ps(w);
+            float* a = acc[j];
+            for (int b = 0; b < 128; b += 8)
+                _mm256_storeu_ps(a + b, _mm256_fmadd_ps(vw, _mm256_load_ps(s + b), _mm256_loadu_ps(a + b)));
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+inline void sh_project_avx512(const float* const* hists, int count, size_t D, float (*acc)[128]) {
+    const SimHashProjection& P = sh_projection();
+    for (int j = 0; j < count; ++j)
+        for (int b = 0; b < 128; b += 16) _mm512_storeu_ps(acc[j] + b, _mm512_setzero_ps());
+    for (size_t d = 0; d < D; ++d) {
+        const float* s = P.sign[d];
+        for (int j = 0; j < count; ++j) {
+            const float w = hists[j][d];
+            if (w == 0.0f) continue;
+            const __m512 vw = _mm512_set1_ps(w);
+            float* a = acc[j];
+            for (int b = 0; b < 128; b += 16)
+                _mm512_storeu_ps(a + b, _mm512_fmadd_ps(vw, _mm512_load_ps(s + b), _mm512_loadu_ps(a + b)));
+        }
+    }
+}
+#endif
+
+using SimHashProjectFn = void (*)(const float* const*, int, size_t, float (*)[128]);
+
+static inline void sh_project(const float* const* hists, int count, size_t D, float (*acc)[128]) {
+#ifdef PAA_X86_SIMD
+    static const SimHashProjectFn fn =
+        distanceIsaSupported(DistanceIsa::AVX512) ? sh_project_avx512 :
+        distanceIsaSupported(DistanceIsa::AVX2)   ? sh_project_avx2 : sh_project_scalar;
+    if (D <= kSimHashMaxDims) { fn(hists, count, D, acc); return; }
+#endif
+    sh_project_scalar(hists, count, D, acc);
+}
+
+// Projeta o histograma nos 128 hiperplanos (acc[b] = <hist, sinais do bit b>)
+static inline void sh_simhash128_accumulate(const float* hist, size_t D, float acc[128]) {
+    const float* one[1] = {hist};
+    sh_project(one, 1, D, reinterpret_cast<float (*)[128]>(acc));
+}
+
+// Bit b da assinatura = sinal de acc[b]; o hiperplano b fica no bit (127 - b) de hi:lo
+static inline Hash128 sh_simhash128_from_acc(const float acc[128]) {
     Hash128 out;
     for (int b = 0; b < 128; ++b) {
-        const bool bit = (acc[b] >= 0.0);
+        const bool bit = (acc[b] >= 0.0f);
         if (b < 64) out.hi = (out.hi << 1) | (bit ? 1ULL : 0ULL);
         else        out.lo = (out.lo << 1) | (bit ? 1ULL : 0ULL);
     }
     return out;
 }
 
+static inline Hash128 sh_simhash128_from_hist(const float* hist, size_t D) {
+    // 128 acumuladores (um “hiperplano” por bit)
+    alignas(64) float acc[128];
+    sh_simhash128_accumulate(hist, D, acc);
+    return sh_simhash128_from_acc(acc);
+}
+
+// Assinaturas de n histogramas de uma vez (ingestão em lote), 4 por bloco
+static inline void sh_simhash128_batch(const float* const* hists, size_t n, size_t D, Hash128* out) {
+    alignas(64) float acc[4][128];
+    for (size_t i = 0; i < n; i += 4) {
+        const int count = (int)std::min<size_t>(4, n - i);
+        sh_project(hists + i, count, D, acc);
+        for (int j = 0; j < count; ++j) out[i + j] = sh_simhash128_from_acc(acc[j]);
+    }
+}
+
+// Hiperplanos [start, start+width) da assinatura como inteiro (width <= 64, start+width <= 128)
+static inline uint64_t sh_bits(const Hash128& h, int start, int width) {
+    const int shift = 128 - start - width;
+    uint64_t v;
+    if (shift >= 64)      v = h.hi >> (shift - 64);
+    else if (shift == 0)  v = h.lo;
+    else                  v = (h.lo >> shift) | (h.hi << (64 - shift));
+    return width == 64 ? v : (v & ((1ULL << width) - 1));
+}
+
+// Assinaturas de todas as linhas do store, indexadas pela linha
+static inline std::vector<Hash128> sh_signatures_for_store(const FeatureStore& store) {
+    std::vector<Hash128> sigs(store.size());
+    std::vector<const float*> rows(store.size());
+    for (uint32_t r = 0; r < store.size(); ++r) rows[r] = store.row(r);
+    sh_simhash128_batch(rows.data(), rows.size(), store.dims(), sigs.data());
+    return sigs;
+}
+
 // ===== Resultado e busca =====
 struct HashSearchResult {
-    // pares (id, distancia_hamming)
-    std::vector<std::pair<std::string,int>> top;
+    // pares (linha no store, distancia_hamming)
+    std::vector<std::pair<uint32_t,int>> top;
+    // qui-quadrado exato de cada item de top (mesma ordem)
+    std::vector<float> distances;
+    // itens comparados por Hamming (SimHashIndex: candidatos dos buckets visitados)
+    size_t candidates = 0;
+    // itens re-ranqueados pelo qui-quadrado exato (0 = top ordenado por Hamming)
+    size_t reranked = 0;
 
-    void print() const {
+    void print(const FeatureStore& store) const {
         std::cout << "\n\n== BUSCA POR HASH (SimHash 128b) ==\n";
+        if (candidates) {
+            std::cout << "(" << candidates << " candidatos";
+            if (reranked) std::cout << ", " << reranked << " re-ranqueados por qui-quadrado";
+            std::cout << ")\n";
+        }
         if (top.empty()) { std::cout << "Nenhum item encontrado.\n"; return; }
         for (size_t i = 0; i < top.size(); ++i) {
-            std::cout << i+1 << ") " << top[i].first
-                      << "  (hamming=" << top[i].second << ")\n";
+            std::cout << i+1 << ") " << store.id(top[i].first)
+                      << "  (hamming=" << top[i].second;
+            if (i < distances.size()) std::cout << ", dist=" << distances[i];
+            std::cout << ")\n";
         }
     }
 };
 
-static inline HashSearchResult searchMostSimilarHash(const std::vector<ImageItem>& base,
-                                                     const ImageItem& query,
-                                                     int topK = 3)
+static inline HashSearchResult searchMostSimilarHash(const FeatureStore& store,
+                                                     const std::vector<uint32_t>& base,
+                                                     const float* query,
+                                                     int topK = 3,
+                                                     const Hash128* signatures = nullptr)
 {
     HashSearchResult result;
-    if (base.empty() || query.histogram.empty()) return result;
-
-    const Hash128 qh = sh_simhash128_from_hist(query.histogram);
+    if (base.empty() || query == nullptr) return result;
 
-    std::vector<std::pair<std::string,int>> all;
-    all.reserve(base.size());
+    const size_t D = store.dims();
+    const Hash128 qh = sh_simhash128_from_hist(query, D);
 
-    for (const auto& it : base) {
-        if (it.histogram.empty()) continue;
-        const Hash128 hh = sh_simhash128_from_hist(it.histogram);
-        int dist = sh_hamming128(qh, hh);
-        all.emplace_back(it.id, dist);
+    // heap limitado aos topK: não ordena a base inteira
+    BoundedTopK<int> best(topK > 0 ? (size_t)topK : 0);
+    for (uint32_t r : base) {
+        const Hash128 hh = signatures ? signatures[r] : sh_simhash128_from_hist(store.row(r), D);
+        best.push(r, sh_hamming128(qh, hh));
     }
 
-    std::sort(all.begin(), all.end(),
-              [](const auto& a, const auto& b){ return a.second < b.second; });
-
-    if ((int)all.size() > topK) all.resize(topK);
-    result.top = std::move(all);
+    for (const auto& hit : best.sorted()) {
+        result.top.emplace_back(hit.row, hit.distance);
+        result.distances.push_back(chiSquareDist(store.row(hit.row), query, D));
+    }
     return result;
 }
+
+/* -----------------------------------------------------------------------------
+   SimHashIndex — LSH por bandas sobre as assinaturas de 128 bits:
+     - a assinatura de cada linha é calculada uma única vez, no insert/build;
+     - L tabelas, cada uma indexada por uma banda de b bits da assinatura;
+       cada tabela é um vetor ordenado (chave, linha) — buscas por equal_range;
+     - multi-probe: além do bucket exato, visita em cada tabela os buckets com
+       um bit trocado, começando pelos bits em que a consulta está mais perto
+       do hiperplano (|acc| menor = bit menos confiável);
+     - candidatos deduplicados e ordenados por Hamming: custo ~ L * (1 + probes)
+       buckets, sublinear em N;
+     - insert() não mexe nas tabelas: cada tabela tem uma cauda ordenada
+       pequena, fundida às tabelas quando passa de ~sqrt(N) entradas
+       (O(L sqrt N) por inserção, amortizado); as buscas olham as duas.
+
+   Parâmetros: tables (L), bandBits (b, 0 = ~log2 N, defaultBandBits) e probes
+   (buckets extras por tabela).
+-----------------------------------------------------------------------------*/
+
+struct SimHashIndexParams {
+    uint32_t tables = 16;
+    uint32_t bandBits = 0;   // 0: escolhido no build a partir de N
+    uint32_t probes = 2;
+};
+
+struct SimHashBucketEntry {
+    uint64_t key;
+    uint32_t row;
+    uint32_t reserved;
+};
+
+class SimHashIndex {
+public:
+    explicit SimHashIndex(const FeatureStore& store, SimHashIndexParams params = {})
+        : store_(store), params_(params) {}
+
+    // Largura das bandas com bandBits = 0: ~log2 N (4 a 32), ~1 linha por bucket
+    static uint32_t defaultBandBits(size_t rows) {
+        uint32_t b = 4;
+        while (b < 32 && (1ULL << b) < rows) ++b;
+        return b;
+    }
+
+    // Constrói todas as tabelas de uma vez; signatures (opcional) indexado por linha
+    void build(const std::vector<uint32_t>& rows, const Hash128* signatures = nullptr) {
+        sigs_.assign(store_.size(), Hash128{});
+        if (signatures) {
+            for (uint32_t r : rows) sigs_[r] = signatures[r];
+        } else {
+            std::vector<const float*> hists(rows.size());
+            std::vector<Hash128> computed(rows.size());
+            for (size_t i = 0; i < rows.size(); ++i) hists[i] = store_.row(rows[i]);
+            sh_simhash128_batch(hists.data(), hists.size(), store_.dims(), computed.data());
+            for (size_t i = 0; i < rows.size(); ++i) sigs_[rows[i]] = computed[i];
+        }
+        sigData_ = sigs_.data();
+
+        autoBandBits_ = params_.bandBits == 0;
+        if (autoBandBits_) params_.bandBits = defaultBandBits(rows.size());
+        if (params_.bandBits > 64) params_.bandBits = 64;
+        if (params_.tables == 0) params_.tables = 1;
+        mapped_ = false;
+        buildTables(rows);
+    }
+
+    // Inserção individual (assinatura calculada aqui, uma vez); a linha entra
+    // nas caudas ordenadas e vai para as tabelas no próximo flush()
+    void insert(uint32_t row) {
+        if (mapped_) throw std::logic_error("SimHashIndex somente leitura");
+        if (params_.bandBits == 0) {   // índice vazio: mesma política do build, N ~ linhas do store
+            autoBandBits_ = true;
+            params_.bandBits = defaultBandBits(store_.size());
+        }
+        if (params_.bandBits > 64) params_.bandBits = 64;
+        if (params_.tables == 0) params_.tables = 1;
+        if (sigs_.size() < store_.size()) sigs_.resize(store_.size());
+        sigs_[row] = sh_simhash128_from_hist(store_.row(row), store_.dims());
+        sigData_ = sigs_.data();
+
+        tails_.resize(params_.tables);
+        for (uint32_t t = 0; t < params_.tables; ++t) {
+            std::vector<SimHashBucketEntry>& tail = tails_[t];
+            SimHashBucketEntry e{bandKey(sigs_[row], t), row, 0};
+            tail.insert(std::upper_bound(tail.begin(), tail.end(), e, entryLess), e);
+        }
+        if (++tailCount_ > std::max<size_t>(64, (size_t)std::sqrt((double)count_))) flush();
+    }
+
+    // Funde as caudas nas tabelas ordenadas (O(L N)); entries() só cobre as
+    // tabelas, então é chamado antes de gravá-las. Com bandBits automático a
+    // largura acompanha ~log2 N: se mudou, as chaves são recalculadas.
+    void flush() {
+        if (tailCount_ == 0) return;
+        const size_t total = count_ + tailCount_;
+        if (autoBandBits_ && defaultBandBits(total) != params_.bandBits) {
+            std::vector<uint32_t> rows;
+            rows.reserve(total);
+            for (size_t i = 0; i < count_; ++i) rows.push_back(entries_[i].row);
+            for (const SimHashBucketEntry& e : tails_[0]) rows.push_back(e.row);
+            params_.bandBits = defaultBandBits(total);
+            buildTables(rows);
+            return;
+        }
+        std::vector<SimHashBucketEntry> merged((size_t)params_.tables * total);
+        for (uint32_t t = 0; t < params_.tables; ++t) {
+            const SimHashBucketEntry* table = entries_.data() + (size_t)t * count_;
+            std::merge(table, table + count_, tails_[t].begin(), tails_[t].end(),
+                       merged.begin() + (size_t)t * total, entryLess);
+        }
+        entries_.swap(merged);
+        entryData_ = entries_.data();
+        count_ = total;
+        clearTails();
+    }
+
+    // Usa tabelas/assinaturas já prontas (ex.: mapeadas do arquivo de índice)
+    void attach(const SimHashIndexParams& params, size_t count,
+                const SimHashBucketEntry* entries, const Hash128* signatures) {
+        params_ = params;
+        count_ = count;
+        entries_.clear();
+        sigs_.clear();
+        clearTails();
+        entryData_ = entries;
+        sigData_ = signatures;
+        mapped_ = true;
+        autoBandBits_ = false;
+    }
+
+    const SimHashIndexParams& params() const { return params_; }
+    size_t size() const { return count_ + tailCount_; }
+    const Hash128* signatures() const { return sigData_; }
+    // Tabelas ordenadas, sem as caudas (flush() antes para ter tudo)
+    const SimHashBucketEntry* entries() const { return entryData_; }
+    size_t entryCount() const { return (size_t)params_.tables * count_; }
+
+    // Bytes das tabelas, caudas e assinaturas (próprias ou mapeadas)
+    size_t memoryBytes() const {
+        return (entryCount() + (size_t)params_.tables * tailCount_) * sizeof(SimHashBucketEntry) +
+               store_.size() * sizeof(Hash128);
+    }
+
+    // Busca top-K por Hamming entre os candidatos dos buckets visitados
+    HashSearchResult search(const float* query, int topK = 3, QueryStats* stats = nullptr) const {
+        QueryTimer timer(stats, QueryPhase::Total);
+        HashSearchResult result;
+        if (size() == 0 || query == nullptr) return result;
+
+        Hash128 qh;
+        std::vector<uint32_t> candidates;
+        {
+            QueryTimer probe(stats, QueryPhase::Probe);
+            candidates = gather(query, qh, stats);
+        }
+        result.candidates = candidates.size();
+
+        BoundedTopK<int> best(topK > 0 ? (size_t)topK : 0);
+        for (uint32_t r : candidates) best.push(r, sh_hamming128(qh, sigData_[r]));
+        statAdd(stats, &QueryStats::distances, best.size());   // qui-quadrado do top, abaixo
+        for (const auto& hit : best.sorted()) {
+            result.top.emplace_back(hit.row, hit.distance);
+            result.distances.push_back(chiSquareDist(store_.row(hit.row), query, store_.dims()));
+        }
+        return result;
+    }
+
+    // Busca em duas etapas: os "rerank" melhores candidatos por Hamming são
+    // re-ranqueados pelo qui-quadrado exato; top sai ordenado pela distância real.
+    // rerank maior = mais recall e mais latência (rerank >= candidatos = exato
+    // dentro dos buckets visitados).
+    // Distance (distance_policy.hpp) escolhe a distância exata do re-rank.
+    template <class Distance = ChiSquareDistance>
+    HashSearchResult searchReranked(const float* query, int topK = 3, size_t rerank = 64,
+                                    QueryStats* stats = nullptr) const {
+        QueryTimer timer(stats, QueryPhase::Total);
+        if (size() == 0 || query == nullptr) return HashSearchResult();
+        alignas(64) float acc[128];
+        {
+            QueryTimer probe(stats, QueryPhase::Probe);
+            sh_simhash128_accumulate(query, store_.dims(), acc);
+        }
+        return rerankedFromAcc<Distance>(query, acc, topK, rerank, stats);
+    }
+
+    // k-NN aproximado com a mesma API das outras estruturas (linha, qui-quadrado)
+    template <class Distance = ChiSquareDistance>
+    std::vector<Neighbor> knn(const float* query, size_t k, size_t rerank = 64,
+                              QueryStats* stats = nullptr) const {
+        const HashSearchResult r = searchReranked<Distance>(query, (int)k, rerank, stats);
+        std::vector<Neighbor> out(r.top.size());
+        for (size_t i = 0; i < out.size(); ++i) out[i] = {r.top[i].first, r.distances[i]};
+        return out;
+    }
+
+    // k-NN de várias consultas: as projeções SimHash são feitas em blocos de 4
+    // (a matriz de sinais é lida uma vez por bloco), o resto é por consulta
+    template <class Distance = ChiSquareDistance>
+    std::vector<std::vector<Neighbor>> searchBatch(const std::vector<const float*>& queries, size_t k,
+                                                   size_t rerank = 64, QueryStats* stats = nullptr) const {
+        QueryTimer timer(stats, QueryPhase::Total);
+        std::vector<std::vector<Neighbor>> out(queries.size());
+        if (size() == 0) return out;
+        alignas(64) float acc[4][128];
+        for (size_t i = 0; i < queries.size(); i += 4) {
+            const int count = (int)std::min<size_t>(4, queries.size() - i);
+            {
+                QueryTimer probe(stats, QueryPhase::Probe);
+                sh_project(queries.data() + i, count, store_.dims(), acc);
+            }
+            for (int j = 0; j < count; ++j) {
+                const HashSearchResult r = rerankedFromAcc<Distance>(queries[i + j], acc[j], (int)k, rerank, stats);
+                out[i + j].resize(r.top.size());
+                for (size_t h = 0; h < r.top.size(); ++h) out[i + j][h] = {r.top[h].first, r.distances[h]};
+            }
+        }
+        return out;
+    }
+
+private:
+    static bool entryLess(const SimHashBucketEntry& a, const SimHashBucketEntry& b) {
+        return a.key < b.key || (a.key == b.key && a.row < b.row);
+    }
+
+    // Tabelas ordenadas com as linhas rows (assinaturas já em sigs_), sem caudas
+    void buildTables(const std::vector<uint32_t>& rows) {
+        count_ = rows.size();
+        entries_.resize((size_t)params_.tables * count_);
+        for (uint32_t t = 0; t < params_.tables; ++t) {
+            SimHashBucketEntry* table = &entries_[(size_t)t * count_];
+            for (size_t i = 0; i < count_; ++i)
+                table[i] = {bandKey(sigs_[rows[i]], t), rows[i], 0};
+            std::sort(table, table + count_, entryLess);
+        }
+        entryData_ = entries_.data();
+        clearTails();
+    }
+
+    void clearTails() {
+        for (auto& tail : tails_) tail.clear();
+        tailCount_ = 0;
+    }
+
+    // searchReranked com a projeção da consulta já calculada
+    template <class Distance>
+    HashSearchResult rerankedFromAcc(const float* query, const float acc[128], int topK, size_t rerank,
+                                     QueryStats* stats) const {
+        HashSearchResult result;
+        Hash128 qh;
+        std::vector<uint32_t> candidates;
+        {
+            QueryTimer probe(stats, QueryPhase::Probe);
+            candidates = gatherFromAcc(acc, qh, stats);
+        }
+        result.candidates = candidates.size();
+        QueryTimer timer(stats, QueryPhase::Rerank);
+
+        // etapa 1: filtro por Hamming (heap limitado, sem ordenar todos)
+        BoundedTopK<int> filtered(std::max<size_t>(rerank, topK > 0 ? (size_t)topK : 0));
+        for (uint32_t r : candidates) filtered.push(r, sh_hamming128(qh, sigData_[r]));
+
+        // etapa 2: distância exata
+        const std::vector<ScoredRow<int>> shortlist = filtered.sorted();
+        result.reranked = shortlist.size();
+        statAdd(stats, &QueryStats::reranked, shortlist.size());
+        statAdd(stats, &QueryStats::distances, shortlist.size());
+        BoundedTopK<float> best(topK > 0 ? (size_t)topK : 0);
+        for (const auto& c : shortlist)
+            best.push(c.row, Distance::eval(store_.row(c.row), query, store_.dims()));
+        for (const auto& hit : best.sorted()) {
+            result.top.emplace_back(hit.row, sh_hamming128(qh, sigData_[hit.row]));
+            result.distances.push_back(hit.distance);
+        }
+        return result;
+    }
+
+    // Bandas espalhadas uniformemente em [0, 128 - b] (sobrepõem se L*b > 128)
+    int bandStart(uint32_t t) const {
+        const int span = 128 - (int)params_.bandBits;
+        return params_.tables > 1 ? (int)(t * (uint64_t)span / (params_.tables - 1)) : 0;
+    }
+
+    uint64_t bandKey(const Hash128& h, uint32_t t) const {
+        return sh_bits(h, bandStart(t), (int)params_.bandBits);
+    }
+
+    // Candidatos (deduplicados) de todos os buckets visitados; qh = assinatura da consulta
+    std::vector<uint32_t> gather(const float* query, Hash128& qh, QueryStats* stats) const {
+        alignas(64) float acc[128];
+        sh_simhash128_accumulate(query, store_.dims(), acc);
+        return gatherFromAcc(acc, qh, stats);
+    }
+
+    // acc = projeção da consulta (128 somas); a assinatura sai em qh
+    std::vector<uint32_t> gatherFromAcc(const float acc[128], Hash128& qh, QueryStats* stats) const {
+        qh = sh_simhash128_from_acc(acc);
+
+        const int width = (int)params_.bandBits;
+        std::vector<uint32_t> candidates;
+        std::vector<std::pair<float,int>> order(width);
+        for (uint32_t t = 0; t < params_.tables; ++t) {
+            const int start = bandStart(t);
+            const uint64_t key = sh_bits(qh, start, width);
+            collect(t, key, candidates);
+
+            // bits da banda do menos para o mais confiável
+            for (int j = 0; j < width; ++j) order[j] = {std::abs(acc[start + j]), j};
+            const int probes = std::min<int>((int)params_.probes, width);
+            std::partial_sort(order.begin(), order.begin() + probes, order.end());
+            for (int p = 0; p < probes; ++p)
+                collect(t, key ^ (1ULL << (width - 1 - order[p].second)), candidates);
+            statAdd(stats, &QueryStats::nodesVisited, 1 + probes);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        statAdd(stats, &QueryStats::candidates, candidates.size());
+        return candidates;
+    }
+
+    // Bucket "key" da tabela t: parte ordenada + cauda
+    void collect(uint32_t t, uint64_t key, std::vector<uint32_t>& out) const {
+        auto keyLess = [](const SimHashBucketEntry& e, uint64_t k) { return e.key < k; };
+        const SimHashBucketEntry* table = entryData_ + (size_t)t * count_;
+        const SimHashBucketEntry* it = std::lower_bound(table, table + count_, key, keyLess);
+        for (; it != table + count_ && it->key == key; ++it) out.push_back(it->row);
+        if (tailCount_ == 0) return;
+        const std::vector<SimHashBucketEntry>& tail = tails_[t];
+        for (auto e = std::lower_bound(tail.begin(), tail.end(), key, keyLess); e != tail.end() && e->key == key; ++e)
+            out.push_back(e->row);
+    }
+
+    const FeatureStore& store_;
+    SimHashIndexParams params_;
+    size_t count_ = 0;
+    std::vector<Hash128> sigs_;                    // indexado pela linha do store
+    std::vector<SimHashBucketEntry> entries_;      // L tabelas de count_ entradas
+    std::vector<std::vector<SimHashBucketEntry>> tails_;   // L caudas ordenadas (inserts)
+    size_t tailCount_ = 0;                         // linhas nas caudas
+    const Hash128* sigData_ = nullptr;
+    const SimHashBucketEntry* entryData_ = nullptr;
+    bool mapped_ = false;                          // tabelas de terceiros: somente leitura
+    bool autoBandBits_ = false;                    // bandBits veio de defaultBandBits
+};
@@ -1,27 +1,136 @@
 #pragma once
-#include "image_item.hpp"
+#include "feature_store.hpp"
+#include "distance_policy.hpp"
+#include "top_k.hpp"
+#include "query_stats.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
 #include <vector>
 #include <string>
+#include <limits>
 #include <iostream>
 using namespace std;
 
 // Resultado da busca na lista
 class ListSearchResult {
 public:
-    string id;
+    uint32_t row;       // linha no FeatureStore (kNoRow se a base estiver vazia)
     float distance;
 
-    ListSearchResult(string &id_, float distance_) {
-        id = id_;
+    ListSearchResult(uint32_t row_, float distance_) {
+        row = row_;
         distance = distance_;
     }
 
-    void print() {
+    void print(const FeatureStore &store) {
         cout << "-> Imagem mais similar encontrada:" << endl;
-        cout << id << " | dist = " << distance << endl;
+        if (row == kNoRow) { cout << "Nenhum item encontrado." << endl; return; }
+        cout << store.id(row) << " | dist = " << distance << endl;
     }
 };
 
-float chiSquare(vector<float> &referenceHistogram, vector<float> &queryHistogram);
+// Busca linear sobre as linhas "index" do store (Distance: ver distance_policy.hpp).
+// stats (opcional, query_stats.hpp) recebe o custo: uma distância por linha.
+template <class Distance = ChiSquareDistance>
+inline ListSearchResult searchMostSimilar(const FeatureStore &store, const vector<uint32_t> &index,
+                                          const float *query, QueryStats *stats = nullptr)
+{
+    QueryTimer timer(stats, QueryPhase::Total);
+    statAdd(stats, &QueryStats::distances, index.size());
+    uint32_t bestRow = kNoRow;
+    float bestDistance = numeric_limits<float>::infinity();
 
-ListSearchResult searchMostSimilar(vector<ImageItem> &index, ImageItem &queryImage);
+    for (size_t i = 0; i < index.size(); i++)
+    {
+        float d = Distance::eval(store.row(index[i]), query, store.dims());
+        if (d < bestDistance)
+        {
+            bestRow = index[i];
+            bestDistance = d;
+        }
+    }
+    return ListSearchResult(bestRow, bestDistance);
+}
+
+// k vizinhos mais próximos na lista (heap limitado, ordem crescente de distância)
+template <class Distance = ChiSquareDistance>
+inline vector<Neighbor> searchKnn(const FeatureStore &store, const vector<uint32_t> &index,
+                                  const float *query, size_t k, QueryStats *stats = nullptr)
+{
+    QueryTimer timer(stats, QueryPhase::Total);
+    statAdd(stats, &QueryStats::distances, index.size());
+    BoundedTopK<float> best(k);
+    for (uint32_t row : index)
+        best.push(row, Distance::eval(store.row(row), query, store.dims()));
+    return best.sorted();
+}
+
+// k-NN de várias consultas em blocos: um bloco de linhas da base (64 x 2 KB,
+// cabe no L2) é comparado com um grupo de consultas (8 x 2 KB, no L1) antes de
+// passar ao próximo, em vez de varrer a base inteira uma vez por consulta.
+template <class Distance = ChiSquareDistance>
+inline vector<vector<Neighbor>> searchBatch(const FeatureStore &store, const vector<uint32_t> &index,
+                                            const vector<const float *> &queries, size_t k,
+                                            QueryStats *stats = nullptr)
+{
+    QueryTimer timer(stats, QueryPhase::Total);
+    statAdd(stats, &QueryStats::distances, index.size() * queries.size());
+    const size_t rowBlock = 64, queryBlock = 8;
+    vector<BoundedTopK<float>> best(queries.size(), BoundedTopK<float>(k));
+
+    for (size_t r0 = 0; r0 < index.size(); r0 += rowBlock)
+    {
+        size_t r1 = min(index.size(), r0 + rowBlock);
+        for (size_t q0 = 0; q0 < queries.size(); q0 += queryBlock)
+        {
+            size_t q1 = min(queries.size(), q0 + queryBlock);
+            for (size_t r = r0; r < r1; r++)
+            {
+                const float *row = store.row(index[r]);
+                for (size_t q = q0; q < q1; q++)
+                    best[q].push(index[r], Distance::eval(row, queries[q], store.dims()));
+            }
+        }
+    }
+
+    vector<vector<Neighbor>> out(queries.size());
+    for (size_t q = 0; q < queries.size(); q++)
+        out[q] = best[q].sorted();
+    return out;
+}
+
+// k-NN exato em paralelo: a base é dividida em faixas contíguas entre as
+// threads do pool; cada uma mantém seu próprio heap limitado (sem trava nem
+// cópia de ids) e os heaps são fundidos no final. Mesmo resultado da busca
+// sequencial, inclusive nos empates (desempate pela linha).
+template <class Distance = ChiSquareDistance>
+inline vector<Neighbor> searchKnnParallel(const FeatureStore &store, const vector<uint32_t> &index,
+                                          const float *query, size_t k, ThreadPool &pool,
+                                          QueryStats *stats = nullptr)
+{
+    QueryTimer timer(stats, QueryPhase::Total);
+    statAdd(stats, &QueryStats::distances, index.size());
+    vector<BoundedTopK<float>> partial(pool.size(), BoundedTopK<float>(k));
+    pool.parallelFor(0, index.size(), [&](int worker, size_t b, size_t e) {
+        BoundedTopK<float> &best = partial[worker];
+        for (size_t i = b; i < e; i++)
+            best.push(index[i], Distance::eval(store.row(index[i]), query, store.dims()));
+    });
+
+    BoundedTopK<float> merged(k);
+    for (const BoundedTopK<float> &best : partial)
+        for (const Neighbor &n : best.sorted())
+            merged.push(n.row, n.distance);
+    return merged.sorted();
+}
+
+template <class Distance = ChiSquareDistance>
+inline ListSearchResult searchMostSimilarParallel(const FeatureStore &store, const vector<uint32_t> &index,
+                                                  const float *query, ThreadPool &pool,
+                                                  QueryStats *stats = nullptr)
+{
+    vector<Neighbor> hit = searchKnnParallel<Distance>(store, index, query, 1, pool, stats);
+    if (hit.empty())
+        return ListSearchResult(kNoRow, numeric_limits<float>::infinity());
+    return ListSearchResult(hit[0].row, hit[0].distance);
+}
@@ -1,208 +1,1082 @@
 #pragma once
-#include "image_item.hpp"
-#include <vector>
+#include "feature_store.hpp"
+#include "distance_policy.hpp"
+#include "top_k.hpp"
+#include "query_stats.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <vector>
 #include <limits>
 #include <cmath>
+#include <cstring>
+#include <queue>
+#include <random>
 #include <iostream>
 using namespace std;
 
-// Função chi-square para o histograma
-inline float chiSquareHist(const vector<float> &h1, const vector<float> &h2)
+/* -----------------------------------------------------------------------------
+   M-Tree com split de folhas e de nós internos (o split sobe até a raiz).
+
+   Promoção (escolha dos dois novos pivôs entre as entradas do nó cheio):
+     Random       — dois aleatórios
+     Sampling     — melhor par (menor raio máximo) entre `samples` pares sorteados
+     MinMaxRadius — mM_RAD / "MinMax": par que minimiza o maior dos dois raios
+     MinSumRadius — m_RAD: par que minimiza a soma dos raios
+   Partição (distribuição das entradas entre os dois pivôs):
+     GeneralizedHyperplane — cada entrada vai para o pivô mais próximo
+     Balanced              — os pivôs escolhem alternadamente a entrada restante
+                             mais próxima (metade para cada lado)
+   O fan-out (`capacity`) é ajustável em tempo de execução.
+
+   A distância é um parâmetro de template (distance_policy.hpp). As podas da
+   busca (d(q, pivô) - raio e distância ao pai) dependem da desigualdade
+   triangular e só são compiladas para políticas com is_metric; com o
+   qui-quadrado puro a árvore continua correta, mas visita tudo. Por isso a
+   MTree padrão usa a raiz do qui-quadrado: é métrica e ordena os vizinhos
+   exatamente como o qui-quadrado (distâncias reportadas em sqrt(chi2)).
+
+   Consultas:
+     knn(query, k)   — best-first: fila de prioridade por max(d(q, pivô) - raio, 0)
+                       e heap limitado com os k melhores; para quando o próximo
+                       limite passa da k-ésima distância.
+     range(query, r) — todos os itens com distância <= r (ordem crescente).
+     searchBatch(queries, k) — k-NN de um grupo de consultas que desce a árvore
+                       junto: cada entrada é lida uma vez e comparada com todas
+                       as consultas do grupo que ainda precisam do nó.
+   Construção em lote (bulkLoad): de cima para baixo, cada nó sorteia até
+   `capacity` pivôs entre seus itens, agrupa cada item no pivô mais próximo e
+   recursa em cada grupo; as subárvores da raiz são construídas em paralelo,
+   cada uma na sua arena, e depois copiadas para a arena da árvore.
+   Antes de calcular d(q, entrada), a distância guardada até o pivô pai dá o
+   limite |d(q, pai) - d(entrada, pai)| <= d(q, entrada) (desigualdade
+   triangular): se ele menos o raio já passa do raio da busca, a entrada é
+   descartada sem nenhum qui-quadrado. QueryStats (query_stats.hpp) conta as distâncias
+   calculadas e as evitadas.
+   knnFiltered(query, k, filtro) — knn com um filtro nas folhas, chamado antes
+                       da distância de cada objeto com a k-ésima distância atual
+                       (ex.: CoarseFilter, coarse_filter.hpp).
+   bestFirst(query, coletor) — o percurso do knn com o raio de poda e o destino
+                       dos objetos definidos pelo coletor (ex.: knnReranked,
+                       quantized_store.hpp).
+   Arena em páginas de kMTPageNodes nós compartilhadas entre cópias da árvore
+   (copy-on-write por página); forEachArenaPage() a expõe para gravação e
+   attach() monta a árvore sobre uma arena externa (arquivo de índice mapeado,
+   index_file.hpp) sem copiar.
+-----------------------------------------------------------------------------*/
+
+enum class MTreePromotion { Random, Sampling, MinMaxRadius, MinSumRadius };
+enum class MTreePartition { GeneralizedHyperplane, Balanced };
+
+struct MTreeParams
 {
-    float sum = 0.0f;
-    for (size_t i = 0; i < h1.size(); i++)
-    {
-        float denom = h1[i] + h2[i];
-        if (denom != 0)
-        {
-            float diff = h1[i] - h2[i];
-            sum += (diff * diff) / denom;
-        }
-    }
-    return sum;
+    size_t capacity = 16;                               // entradas por nó (fan-out)
+    MTreePromotion promotion = MTreePromotion::MinMaxRadius;
+    MTreePartition partition = MTreePartition::GeneralizedHyperplane;
+    size_t samples = 8;                                 // pares avaliados em Sampling
+    uint64_t seed = 0x5eed;                             // Random / Sampling
+};
+
+inline bool parseMTreePromotion(const char *s, MTreePromotion &out)
+{
+    if (!strcmp(s, "random"))        out = MTreePromotion::Random;
+    else if (!strcmp(s, "sampling")) out = MTreePromotion::Sampling;
+    else if (!strcmp(s, "mmrad") || !strcmp(s, "minmax")) out = MTreePromotion::MinMaxRadius;
+    else if (!strcmp(s, "mrad"))     out = MTreePromotion::MinSumRadius;
+    else return false;
+    return true;
 }
 
-// Nó da M-Tree
-class MTNode
+inline bool parseMTreePartition(const char *s, MTreePartition &out)
 {
-public:
-    ImageItem obj;        // objeto representativo (pivô)
-    float coveringRadius; // raio que cobre seus filhos
-    bool leaf;
+    if (!strcmp(s, "hyperplane"))    out = MTreePartition::GeneralizedHyperplane;
+    else if (!strcmp(s, "balanced")) out = MTreePartition::Balanced;
+    else return false;
+    return true;
+}
 
-    vector<ImageItem> items; // usado se for folha
-    vector<unique_ptr<MTNode>> children;
+// Entrada de um nó (16 bytes, 4 por cache line): objeto (folha) ou pivô de
+// roteamento + índice do nó filho (interno). Só os campos lidos na busca.
+struct MTEntry
+{
+    uint32_t row;          // linha no FeatureStore
+    float radius;          // raio de cobertura da subárvore (0 em folhas)
+    float parentDist;      // distância ao pivô do nó pai (0 na raiz)
+    uint32_t child;        // índice do nó filho (kNoRow em folhas)
+};
+static_assert(sizeof(MTEntry) == 16, "MTEntry deve caber em 16 bytes");
+
+// Metadados do nó; as entradas ficam na arena da árvore, em um bloco contíguo
+// de capacity + 1 posições (a posição extra recebe o estouro antes do split)
+struct MTNode
+{
+    uint32_t count = 0;
+    uint32_t leaf = 1;     // 32 bits: sem bytes de enchimento (o nó vai para o arquivo)
+};
+static_assert(sizeof(MTNode) == 8, "MTNode deve caber em 8 bytes");
+
+// A arena é dividida em páginas de kMTPageNodes nós (com as entradas deles).
+// Cópias da árvore compartilham as páginas; escrever em um nó de página
+// compartilhada copia só aquela página (copy-on-write por página).
+static constexpr uint32_t kMTPageShift = 5;
+static constexpr uint32_t kMTPageNodes = 1u << kMTPageShift;
 
-    MTNode(const ImageItem &o, bool isLeaf = true)
-        : obj(o), leaf(isLeaf), coveringRadius(0.0f) {}
+struct MTPage
+{
+    MTNode *nodes = nullptr;         // kMTPageNodes nós
+    MTEntry *entries = nullptr;      // kMTPageNodes * (capacity + 1) entradas
+    uint32_t size = kMTPageNodes;    // nós legíveis (a última página externa pode ser parcial)
+    unique_ptr<MTNode[]> ownNodes;   // vazios em páginas de memória externa (somente leitura)
+    unique_ptr<MTEntry[]> ownEntries;
 };
 
 // Estrutura de Resultado da busca
 class MTreeSearchResult
 {
 public:
-    string id;
+    uint32_t row;       // linha no FeatureStore (kNoRow se a árvore estiver vazia)
     float distance;
 
-    MTreeSearchResult(const string &id_, float dist_)
-        : id(id_), distance(dist_) {}
+    MTreeSearchResult(uint32_t row_, float dist_)
+        : row(row_), distance(dist_) {}
 
-    void print()
+    void print(const FeatureStore &store)
     {
         cout << "-> Imagem mais similar encontrada:" << endl;
-        cout << id << " | dist = " << distance << endl;
+        if (row == kNoRow) { cout << "Nenhum item encontrado." << endl; return; }
+        cout << store.id(row) << " | dist = " << distance << endl;
     }
 };
 
+// Acesso às linhas pela M-Tree. Outro formato de linha (ex.: QuantizedStore,
+// quantized_store.hpp) entra como parâmetro Store com as mesmas três funções.
+template <class Distance>
+inline float rowDistance(const FeatureStore &store, uint32_t a, const float *b)
+{
+    return Distance::eval(store.row(a), b, store.dims());
+}
+
+template <class Distance>
+inline float rowDistance(const FeatureStore &store, uint32_t a, uint32_t b)
+{
+    return Distance::eval(store.row(a), store.row(b), store.dims());
+}
+
+// Filtro das folhas que não descarta nada (knn sem filtro)
+struct NoLeafFilter
+{
+    bool rejects(uint32_t, float, QueryStats *) const { return false; }
+};
+
+// Coletor do knn: top-k na distância da árvore, com o filtro das folhas
+template <class LeafFilter>
+struct MTreeTopK
+{
+    BoundedTopK<float> best;
+    const LeafFilter &filter;
+
+    float bound() const { return best.worst(); }
+    bool rejects(uint32_t row, QueryStats *stats) const { return filter.rejects(row, best.worst(), stats); }
+    void offer(uint32_t row, float d) { best.push(row, d); }
+};
+
+// Linha r como floats; formatos compactos decodificam em buf (dims floats)
+inline const float *rowVector(const FeatureStore &store, uint32_t r, float *)
+{
+    return store.row(r);
+}
+
 // Classe da M-Tree
-class MTree
+// Todos os nós vivem na arena paginada (pages_): o nó n é o nó n % kMTPageNodes
+// da página n / kMTPageNodes, com capacity + 1 entradas contíguas. Filhos são
+// índices, não ponteiros. Copiar a árvore copia só a tabela de páginas; cada
+// escrita depois disso copia as páginas do caminho que ela altera.
+template <class Distance, class Store = FeatureStore>
+class BasicMTree
 {
+public:
+    using distance_type = Distance;
+    using store_type = Store;
+
 private:
-    unique_ptr<MTNode> root;
-    const int maxLeafSize = 3;
+    const Store &store;
+    MTreeParams params_;
+    size_t stride_;                // entradas reservadas por nó (capacity + 1)
+    vector<shared_ptr<MTPage>> pages_;
+    size_t nodeTotal_ = 0;         // nós já alocados na arena (livres inclusos)
+    uint32_t root_ = kNoRow;
+    vector<uint32_t> freeNodes_;   // nós livres da arena (após remove)
+    size_t count = 0;
+    mt19937_64 rng;
+
+    // rascunho do split (reaproveitado entre splits)
+    vector<MTEntry> splitAll_;
+    vector<float> splitMemo_;
+    vector<uint8_t> splitSide_, splitBestSide_;
+
+    float dist(uint32_t a, const float *b) const { return rowDistance<Distance>(store, a, b); }
+
+    float dist(uint32_t a, uint32_t b) const { return rowDistance<Distance>(store, a, b); }
+
+    const MTNode &nodeAt(uint32_t node) const { return pages_[node >> kMTPageShift]->nodes[node & (kMTPageNodes - 1)]; }
+
+    const MTEntry *entriesOf(uint32_t node) const
+    {
+        return pages_[node >> kMTPageShift]->entries + (size_t)(node & (kMTPageNodes - 1)) * stride_;
+    }
+
+    // Acesso para escrita: a página passa a ser só desta árvore antes
+    MTNode &mutableNode(uint32_t node) { return writablePage(node >> kMTPageShift).nodes[node & (kMTPageNodes - 1)]; }
+
+    MTEntry *mutableEntries(uint32_t node)
+    {
+        return writablePage(node >> kMTPageShift).entries + (size_t)(node & (kMTPageNodes - 1)) * stride_;
+    }
+
+    MTPage &writablePage(size_t p)
+    {
+        shared_ptr<MTPage> &page = pages_[p];
+        if (page.use_count() == 1 && page->ownNodes)
+        {
+            // a última outra versão pode ter acabado de soltar a página:
+            // sincroniza com as leituras dela antes de escrever
+            atomic_thread_fence(memory_order_acquire);
+            return *page;
+        }
+        shared_ptr<MTPage> copy = newPage();
+        std::copy(page->nodes, page->nodes + page->size, copy->nodes);
+        std::copy(page->entries, page->entries + page->size * stride_, copy->entries);
+        page = move(copy);
+        return *page;
+    }
+
+    shared_ptr<MTPage> newPage() const
+    {
+        auto page = make_shared<MTPage>();
+        page->ownNodes.reset(new MTNode[kMTPageNodes]());
+        page->ownEntries.reset(new MTEntry[kMTPageNodes * stride_]());
+        page->nodes = page->ownNodes.get();
+        page->entries = page->ownEntries.get();
+        return page;
+    }
+
+    // Nó da arena da árvore; reaproveita nós esvaziados por remove()
+    uint32_t allocNode(bool leaf)
+    {
+        uint32_t id;
+        if (!freeNodes_.empty())
+        {
+            id = freeNodes_.back();
+            freeNodes_.pop_back();
+        }
+        else
+        {
+            id = (uint32_t)nodeTotal_++;
+            if ((id & (kMTPageNodes - 1)) == 0)
+                pages_.push_back(newPage());
+        }
+        mutableNode(id) = {0, leaf};
+        return id;
+    }
+
+    // Arena montada em vetores contíguos (bulkLoad) copiada para páginas novas
+    void adoptArena(const vector<MTNode> &nodes, const vector<MTEntry> &entries)
+    {
+        pages_.clear();
+        nodeTotal_ = nodes.size();
+        for (size_t first = 0; first < nodes.size(); first += kMTPageNodes)
+        {
+            shared_ptr<MTPage> page = newPage();
+            size_t n = min<size_t>(kMTPageNodes, nodes.size() - first);
+            std::copy(nodes.begin() + first, nodes.begin() + first + n, page->nodes);
+            std::copy(entries.begin() + first * stride_, entries.begin() + (first + n) * stride_, page->entries);
+            pages_.push_back(move(page));
+        }
+    }
+
+    uint32_t allocNode(vector<MTNode> &nodes, vector<MTEntry> &entries, bool leaf) const
+    {
+        uint32_t id = (uint32_t)nodes.size();
+        nodes.push_back({0, leaf});
+        entries.resize(nodes.size() * stride_);
+        return id;
+    }
 
 public:
-    MTree() {}
+    explicit BasicMTree(const Store &store_, const MTreeParams &params = {})
+        : store(store_), params_(params), rng(params.seed)
+    {
+        if (params_.capacity < 2) params_.capacity = 2; // split precisa de 2 lados
+        stride_ = params_.capacity + 1;
+    }
+
+    const MTreeParams &params() const { return params_; }
+    size_t size() const { return count; }
+    uint32_t root() const { return root_; }
+    size_t arenaNodes() const { return nodeTotal_; }
+
+    // Arena em pedaços contíguos, na ordem dos nós (serialização sem cópia):
+    // f(nós, quantos, entradas de todos eles)
+    template <class F>
+    void forEachArenaPage(F f) const
+    {
+        for (size_t p = 0; p < pages_.size(); p++)
+            f(static_cast<const MTNode *>(pages_[p]->nodes),
+              (uint32_t)min<size_t>(kMTPageNodes, nodeTotal_ - p * kMTPageNodes),
+              static_cast<const MTEntry *>(pages_[p]->entries));
+    }
+
+    // Árvore sobre uma arena externa (ex.: arquivo de índice mapeado), sem
+    // copiar: nodeData com nodes nós e entryData com nodes * (capacity + 1)
+    // entradas, já validados. Escritas posteriores copiam as páginas tocadas.
+    void attach(const MTreeParams &params, uint32_t root, size_t items, size_t nodes,
+                const MTNode *nodeData, const MTEntry *entryData)
+    {
+        params_ = params;
+        stride_ = params_.capacity + 1;
+        rng.seed(params_.seed);
+        pages_.clear();
+        freeNodes_.clear();
+        nodeTotal_ = nodes;
+        root_ = root;
+        count = items;
+        for (size_t first = 0; first < nodes; first += kMTPageNodes)
+        {
+            auto page = make_shared<MTPage>();
+            page->nodes = const_cast<MTNode *>(nodeData + first);
+            page->entries = const_cast<MTEntry *>(entryData + first * stride_);
+            page->size = (uint32_t)min<size_t>(kMTPageNodes, nodes - first);
+            pages_.push_back(move(page));
+        }
+    }
+    size_t nodeCount() const { return nodeTotal_ - freeNodes_.size(); }
+
+    // Bytes da arena (páginas + tabela de páginas)
+    size_t memoryBytes() const
+    {
+        return pages_.size() * kMTPageNodes * (sizeof(MTNode) + stride_ * sizeof(MTEntry)) +
+               pages_.capacity() * sizeof(shared_ptr<MTPage>);
+    }
+
+    // Reserva a tabela de páginas para ~items objetos (nós ~ meio cheios)
+    void reserve(size_t items)
+    {
+        size_t nodes = 2 * items / params_.capacity + 2;
+        pages_.reserve(nodes / kMTPageNodes + 1);
+    }
+
+    void build(const vector<uint32_t> &rows)
+    {
+        reserve(count + rows.size());
+        for (uint32_t row : rows)
+            insert(row);
+    }
 
-    void insert(const ImageItem &item)
+    // Constrói a árvore inteira de uma vez (descarta o conteúdo anterior)
+    void bulkLoad(const vector<uint32_t> &rows, int threads = defaultThreadCount())
     {
-        if (!root)
+        pages_.clear();
+        nodeTotal_ = 0;
+        freeNodes_.clear();
+        root_ = kNoRow;
+        count = rows.size();
+        if (rows.empty())
+            return;
+
+        // montada em dois vetores contíguos e paginada no fim
+        vector<MTNode> nodes;
+        vector<MTEntry> entries;
+        vector<uint32_t> items = rows;
+        float radius;
+        if (items.size() <= params_.capacity)
         {
-            root = make_unique<MTNode>(item, true);
-            root->items.push_back(item);
+            root_ = bulkBuild(items, kNoRow, nodes, entries, rng, radius);
+            adoptArena(nodes, entries);
             return;
         }
-        insertRecursive(root.get(), item);
+
+        // agrupamento da raiz em paralelo (N x capacity distâncias)
+        ThreadPool pool(threads);
+        vector<uint32_t> pivots;
+        vector<vector<uint32_t>> groups;
+        cluster(items, rng, pivots, groups, &pool);
+        items.clear();
+        items.shrink_to_fit();
+
+        // cada subárvore da raiz em sua própria arena, uma tarefa por grupo
+        const size_t k = pivots.size();
+        vector<vector<MTNode>> subNodes(k);
+        vector<vector<MTEntry>> subEntries(k);
+        vector<uint32_t> subRoot(k);
+        vector<float> subRadius(k);
+        for (size_t j = 0; j < k; j++)
+            pool.submit([&, j] {
+                mt19937_64 local(params_.seed + 1 + j);
+                subRoot[j] = bulkBuild(groups[j], pivots[j], subNodes[j], subEntries[j], local, subRadius[j]);
+                vector<uint32_t>().swap(groups[j]);
+            });
+        pool.wait();
+
+        size_t totalNodes = 1;
+        for (size_t j = 0; j < k; j++)
+            totalNodes += subNodes[j].size();
+        nodes.reserve(totalNodes);
+        entries.reserve(totalNodes * stride_);
+
+        root_ = allocNode(nodes, entries, false);
+        for (size_t j = 0; j < k; j++)
+        {
+            uint32_t offset = (uint32_t)nodes.size();
+            nodes.insert(nodes.end(), subNodes[j].begin(), subNodes[j].end());
+            for (MTEntry e : subEntries[j])
+            {
+                if (e.child != kNoRow)
+                    e.child += offset;
+                entries.push_back(e);
+            }
+            entries[(size_t)root_ * stride_ + j] = {pivots[j], subRadius[j], 0.0f, subRoot[j] + offset};
+            vector<MTNode>().swap(subNodes[j]);
+            vector<MTEntry>().swap(subEntries[j]);
+        }
+        nodes[root_].count = (uint32_t)k;
+        adoptArena(nodes, entries);
+    }
+
+    void insert(uint32_t item)
+    {
+        if (root_ == kNoRow)
+            root_ = allocNode(true);
+
+        MTEntry promoted[2];
+        if (insertRecursive(root_, kNoRow, item, 0.0f, promoted))
+        {
+            // split da raiz: nova raiz com os dois pivôs promovidos
+            root_ = allocNode(false);
+            MTEntry *e = mutableEntries(root_);
+            e[0] = promoted[0];
+            e[1] = promoted[1];
+            mutableNode(root_).count = 2;
+        }
+        count++;
+    }
+
+    // Remove uma ocorrência de `row`; false se não estiver na árvore.
+    // Os raios não encolhem (continuam limites válidos); folhas vazias saem do
+    // pai e a raiz com um só filho é colapsada. A linha continua no store e
+    // pode seguir como pivô de roteamento.
+    bool remove(uint32_t row)
+    {
+        if (root_ == kNoRow)
+            return false;
+        vector<float> buf(store.dims());
+        const float *x = rowVector(store, row, buf.data());
+        // primeiro só pelas subárvores que cobrem a linha (métricas); depois a árvore toda
+        int r = 0;
+        if constexpr (Distance::is_metric)
+            r = removeRecursive(root_, row, x, true);
+        if (r == 0)
+            r = removeRecursive(root_, row, x, false);
+        if (r == 0)
+            return false;
+
+        count--;
+        if (nodeAt(root_).count == 0)
+        {
+            freeNodes_.push_back(root_);
+            root_ = kNoRow;
+        }
+        while (root_ != kNoRow && !nodeAt(root_).leaf && nodeAt(root_).count == 1)
+        {
+            freeNodes_.push_back(root_);
+            root_ = entriesOf(root_)[0].child;
+        }
+        return true;
+    }
+
+    // Linhas guardadas nas folhas (ordem da árvore)
+    vector<uint32_t> rows() const
+    {
+        vector<uint32_t> out;
+        out.reserve(count);
+        if (root_ != kNoRow)
+            collectRows(root_, out);
+        return out;
+    }
+
+    // Altura da árvore (0 se vazia); útil para comparar fan-outs
+    size_t height() const
+    {
+        size_t h = 0;
+        for (uint32_t n = root_; n != kNoRow; n = nodeAt(n).leaf ? kNoRow : entriesOf(n)[0].child)
+            h++;
+        return h;
     }
 
     // Busca: retorna o mais similar
-    MTreeSearchResult searchMostSimilar(const ImageItem &query)
+    MTreeSearchResult searchMostSimilar(const float *query, QueryStats *stats = nullptr) const
     {
-        string bestId = "";
-        float bestDist = numeric_limits<float>::infinity();
-        searchRecursive(root.get(), query, bestId, bestDist);
-        return MTreeSearchResult(bestId, bestDist);
+        vector<Neighbor> hit = knn(query, 1, stats);
+        if (hit.empty())
+            return MTreeSearchResult(kNoRow, numeric_limits<float>::infinity());
+        return MTreeSearchResult(hit[0].row, hit[0].distance);
     }
 
-private:
-    // Inserção recursiva
-    void insertRecursive(MTNode *node, const ImageItem &item)
+    // k vizinhos mais próximos (ordem crescente de distância)
+    vector<Neighbor> knn(const float *query, size_t k, QueryStats *stats = nullptr) const
+    {
+        return knnFiltered(query, k, NoLeafFilter{}, stats);
+    }
+
+    // knn em que filter.rejects(row, pior distância do top-k, stats) descarta
+    // objetos das folhas antes da distância exata (só limites inferiores válidos)
+    template <class LeafFilter>
+    vector<Neighbor> knnFiltered(const float *query, size_t k, const LeafFilter &filter,
+                                 QueryStats *stats = nullptr) const
+    {
+        QueryTimer timer(stats, QueryPhase::Total);
+        MTreeTopK<LeafFilter> top{BoundedTopK<float>(k), filter};
+        if (k > 0)
+            bestFirst(query, top, stats);
+        return top.best.sorted();
+    }
+
+    // Percurso best-first genérico (base do knn): descarta toda subárvore ou
+    // objeto cujo limite inferior passa de c.bound() (que só pode diminuir) e
+    // entrega os objetos das folhas restantes a c.offer(linha, distância),
+    // menos os que c.rejects(linha, stats) descartar antes da distância
+    template <class Collector>
+    void bestFirst(const float *query, Collector &c, QueryStats *stats = nullptr) const
     {
-        float dist = chiSquareHist(node->obj.histogram, item.histogram);
+        if (root_ == kNoRow)
+            return;
 
-        // Atualiza raio de cobertura
-        if (dist > node->coveringRadius)
-            node->coveringRadius = dist;
+        // nó pendente: limite inferior e distância da consulta ao pivô do nó
+        struct Pending
+        {
+            float lowerBound;
+            float pivotDist; // < 0 na raiz (sem pivô)
+            uint32_t node;
+            bool operator>(const Pending &o) const { return lowerBound > o.lowerBound; }
+        };
+        priority_queue<Pending, vector<Pending>, greater<Pending>> queue;
+        queue.push({0.0f, -1.0f, root_});
 
-        if (node->leaf)
+        while (!queue.empty())
         {
-            node->items.push_back(item);
+            Pending p = queue.top();
+            queue.pop();
+            // poda: nenhuma subárvore restante pode entrar no resultado
+            if (p.lowerBound > c.bound())
+            {
+                statAdd(stats, &QueryStats::subtreesPruned, queue.size() + 1);
+                break;
+            }
+            statAdd(stats, &QueryStats::nodesVisited);
 
-            // split simples (promoção)
-            if ((int)node->items.size() > maxLeafSize)
-                splitLeaf(node);
+            const MTNode &node = nodeAt(p.node);
+            const MTEntry *entries = entriesOf(p.node);
+            for (uint32_t i = 0; i < node.count; i++)
+            {
+                const MTEntry &e = entries[i];
+                if (parentLowerBound<Distance>(p.pivotDist, e.parentDist, e.radius) > c.bound())
+                {
+                    statAdd(stats, &QueryStats::avoided);
+                    if (!node.leaf)
+                        statAdd(stats, &QueryStats::subtreesPruned);
+                    continue;
+                }
+                if (node.leaf && c.rejects(e.row, stats))
+                    continue;
+                float d = dist(e.row, query);
+                statAdd(stats, &QueryStats::distances);
+                if (node.leaf)
+                    c.offer(e.row, d);
+                else
+                {
+                    float lb = subtreeLowerBound<Distance>(d, e.radius);
+                    if (lb <= c.bound())
+                        queue.push({lb, d, e.child});
+                    else
+                        statAdd(stats, &QueryStats::subtreesPruned);
+                }
+            }
         }
-        else
+    }
+
+    // k-NN de várias consultas, em grupos que percorrem a árvore juntos
+    vector<vector<Neighbor>> searchBatch(const vector<const float *> &queries, size_t k,
+                                         QueryStats *stats = nullptr) const
+    {
+        QueryTimer timer(stats, QueryPhase::Total);
+        vector<BoundedTopK<float>> best(queries.size(), BoundedTopK<float>(k));
+        if (root_ != kNoRow && k > 0)
         {
-            // Escolhe filho mais próximo ao item
-            MTNode *bestChild = nullptr;
-            float bestChildDist = numeric_limits<float>::infinity();
+            const size_t group = 16;
+            for (size_t q0 = 0; q0 < queries.size(); q0 += group)
+            {
+                vector<uint32_t> active;
+                for (size_t q = q0; q < min(queries.size(), q0 + group); q++)
+                    active.push_back((uint32_t)q);
+                vector<float> pivotDist(active.size(), -1.0f);
+                groupSearch(root_, active, pivotDist, queries, best, stats);
+            }
+        }
+        vector<vector<Neighbor>> out(queries.size());
+        for (size_t q = 0; q < queries.size(); q++)
+            out[q] = best[q].sorted();
+        return out;
+    }
 
-            for (auto &child : node->children)
+    // Todos os itens a distância <= radius (ordem crescente de distância)
+    vector<Neighbor> range(const float *query, float radius, QueryStats *stats = nullptr) const
+    {
+        QueryTimer timer(stats, QueryPhase::Total);
+        vector<Neighbor> out;
+        if (root_ != kNoRow)
+            rangeRecursive(root_, -1.0f, query, radius, out, stats);
+        sort(out.begin(), out.end(), [](const Neighbor &a, const Neighbor &b) {
+            return a.distance < b.distance || (a.distance == b.distance && a.row < b.row);
+        });
+        return out;
+    }
+
+private:
+    // Insere item na subárvore `node` (cujo pivô é `pivot`, a distância dItem).
+    // Se o nó estourar, é dividido e as duas entradas promovidas voltam em `out`.
+    bool insertRecursive(uint32_t node, uint32_t pivot, uint32_t item, float dItem, MTEntry out[2])
+    {
+        if (nodeAt(node).leaf)
+        {
+            MTNode &leaf = mutableNode(node);
+            mutableEntries(node)[leaf.count++] = {item, 0.0f, dItem, kNoRow};
+        }
+        else
+        {
+            // Subárvore que já cobre o item (a mais próxima); senão, a que menos
+            // precisa crescer o raio
+            const MTEntry *entries = entriesOf(node);
+            uint32_t best = 0;
+            float bestD = numeric_limits<float>::infinity();
+            float bestGrow = numeric_limits<float>::infinity();
+            bool covered = false;
+            for (uint32_t i = 0; i < nodeAt(node).count; i++)
             {
-                float d = chiSquareHist(child->obj.histogram, item.histogram);
-                if (d < bestChildDist)
+                const MTEntry &e = entries[i];
+                float d = dist(item, e.row);
+                if (d <= e.radius)
+                {
+                    if (!covered || d < bestD) { best = i; bestD = d; }
+                    covered = true;
+                }
+                else if (!covered && d - e.radius < bestGrow)
                 {
-                    bestChild = child.get();
-                    bestChildDist = d;
+                    best = i; bestD = d; bestGrow = d - e.radius;
                 }
             }
 
-            insertRecursive(bestChild, item);
+            MTEntry target = entries[best];
+            if (bestD > target.radius)
+                mutableEntries(node)[best].radius = bestD;
+
+            MTEntry promoted[2];
+            // a recursão pode copiar páginas: nada de ponteiros guardados
+            if (insertRecursive(target.child, target.row, item, bestD, promoted))
+            {
+                for (MTEntry &p : promoted)
+                    p.parentDist = pivot == kNoRow ? 0.0f : dist(p.row, pivot);
+                MTNode &inner = mutableNode(node);
+                MTEntry *dst = mutableEntries(node);
+                dst[best] = promoted[0];
+                dst[inner.count++] = promoted[1];
+            }
         }
+
+        if (nodeAt(node).count <= params_.capacity)
+            return false;
+        split(node, out);
+        return true;
     }
 
-    // Split de folha (simples)
-    void splitLeaf(MTNode *node)
+    // Divide um nó cheio em dois: um lado fica no próprio nó, o outro vai para
+    // um nó novo da arena
+    void split(uint32_t node, MTEntry out[2])
     {
-        if (!node->leaf)
-            return;
+        const size_t n = nodeAt(node).count;
+        vector<MTEntry> &all = splitAll_;
+        all.assign(entriesOf(node), entriesOf(node) + n);
 
-        // promove 1 como pivô novo
-        ImageItem newPivot = node->items.back();
-        node->items.pop_back();
+        // distâncias entre entradas, calculadas sob demanda (qui-quadrado é simétrico)
+        vector<float> &memo = splitMemo_;
+        memo.assign(n * n, -1.0f);
+        auto D = [&](size_t i, size_t j) -> float {
+            if (i == j) return 0.0f;
+            float &v = memo[i * n + j];
+            if (v < 0.0f)
+                v = memo[j * n + i] = dist(all[i].row, all[j].row);
+            return v;
+        };
 
-        auto newChild = make_unique<MTNode>(newPivot, true);
-        newChild->items.push_back(newPivot);
+        vector<uint8_t> &side = splitSide_, &bestSide = splitBestSide_;
+        side.resize(n);
+        float r[2], bestR[2] = {0.0f, 0.0f};
+        size_t p1 = 0, p2 = 1;
 
-        // distribuir elementos
-        vector<ImageItem> remaining = node->items;
-        node->items.clear();
+        auto consider = [&](size_t a, size_t b, float &bestCost) {
+            partition(a, b, n, D, all, side, r);
+            float cost = params_.promotion == MTreePromotion::MinSumRadius ? r[0] + r[1] : max(r[0], r[1]);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                p1 = a; p2 = b;
+                bestSide = side;
+                bestR[0] = r[0]; bestR[1] = r[1];
+            }
+        };
 
-        for (auto &it : remaining)
+        float bestCost = numeric_limits<float>::infinity();
+        switch (params_.promotion)
         {
-            float d1 = chiSquareHist(node->obj.histogram, it.histogram);
-            float d2 = chiSquareHist(newPivot.histogram, it.histogram);
+        case MTreePromotion::Random:
+        {
+            size_t a = rng() % n, b = rng() % (n - 1);
+            consider(a, b >= a ? b + 1 : b, bestCost);
+            break;
+        }
+        case MTreePromotion::Sampling:
+            for (size_t s = 0; s < max<size_t>(params_.samples, 1); s++)
+            {
+                size_t a = rng() % n, b = rng() % (n - 1);
+                consider(a, b >= a ? b + 1 : b, bestCost);
+            }
+            break;
+        case MTreePromotion::MinMaxRadius:
+        case MTreePromotion::MinSumRadius:
+            for (size_t a = 0; a < n; a++)
+                for (size_t b = a + 1; b < n; b++)
+                    consider(a, b, bestCost);
+            break;
+        }
 
-            if (d1 < d2)
-                node->items.push_back(it);
-            else
-                newChild->items.push_back(it);
+        bool leaf = nodeAt(node).leaf;
+        uint32_t targets[2] = {node, allocNode(leaf)};
+        size_t pivots[2] = {p1, p2};
+        for (int s = 0; s < 2; s++)
+        {
+            MTEntry *dst = mutableEntries(targets[s]);
+            uint32_t c = 0;
+            for (size_t i = 0; i < n; i++)
+                if (bestSide[i] == s)
+                {
+                    dst[c] = all[i];
+                    dst[c].parentDist = D(i, pivots[s]);
+                    c++;
+                }
+            mutableNode(targets[s]).count = c;
+            out[s] = {all[pivots[s]].row, bestR[s], 0.0f /* definido pelo chamador */, targets[s]};
         }
+    }
+    // Sorteia até `capacity` pivôs entre os itens e agrupa cada item no pivô
+    // mais próximo (o pivô fica sempre no próprio grupo). Empates se revezam
+    // entre os pivôs empatados; se mesmo assim nada se separou (todos os itens
+    // num grupo só), corta os itens ao meio para a recursão ficar logarítmica.
+    void cluster(vector<uint32_t> &items, mt19937_64 &gen, vector<uint32_t> &pivots,
+                 vector<vector<uint32_t>> &groups, ThreadPool *pool = nullptr) const
+    {
+        const size_t n = items.size(), k = min(params_.capacity, n);
+        for (size_t i = 0; i < k; i++) // Fisher-Yates parcial: pivôs em items[0, k)
+            swap(items[i], items[i + gen() % (n - i)]);
+        pivots.assign(items.begin(), items.begin() + k);
+
+        vector<uint32_t> nearest(n);
+        auto assign = [&](int, size_t b, size_t e) {
+            vector<float> buf(store.dims());
+            vector<uint32_t> tied;
+            for (size_t i = b; i < e; i++)
+            {
+                if (i < k) { nearest[i] = (uint32_t)i; continue; }
+                const float *x = rowVector(store, items[i], buf.data());
+                float bestD = numeric_limits<float>::infinity();
+                for (size_t j = 0; j < k; j++)
+                {
+                    float d = dist(pivots[j], x);
+                    if (d < bestD) { bestD = d; tied.clear(); }
+                    if (d == bestD) tied.push_back((uint32_t)j);
+                }
+                nearest[i] = tied[i % tied.size()];
+            }
+        };
+        if (pool)
+            pool->parallelFor(0, n, assign);
+        else
+            assign(0, 0, n);
 
-        // agora vira nó interno (split root)
-        if (node == root.get())
+        groups.assign(k, {});
+        for (size_t i = 0; i < n; i++)
+            groups[nearest[i]].push_back(items[i]);
+
+        for (const vector<uint32_t> &g : groups)
+            if (g.size() == n - k + 1)
+            {
+                const size_t half = n / 2;
+                pivots.assign({items[0], items[half]});
+                groups.assign(2, {});
+                groups[0].assign(items.begin(), items.begin() + half);
+                groups[1].assign(items.begin() + half, items.end());
+                break;
+            }
+    }
+
+    // Subárvore com os itens dados cujo pivô de roteamento é `pivot` (kNoRow na
+    // raiz); devolve o índice do nó na arena e o raio de cobertura em `radius`
+    uint32_t bulkBuild(vector<uint32_t> &items, uint32_t pivot, vector<MTNode> &nodes,
+                       vector<MTEntry> &entries, mt19937_64 &gen, float &radius) const
+    {
+        radius = 0.0f;
+        if (items.size() <= params_.capacity)
+        {
+            uint32_t node = allocNode(nodes, entries, true);
+            MTEntry *dst = entries.data() + (size_t)node * stride_;
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                float d = pivot == kNoRow ? 0.0f : dist(items[i], pivot);
+                dst[i] = {items[i], 0.0f, d, kNoRow};
+                radius = max(radius, d);
+            }
+            nodes[node].count = (uint32_t)items.size();
+            return node;
+        }
+
+        vector<uint32_t> pivots;
+        vector<vector<uint32_t>> groups;
+        cluster(items, gen, pivots, groups);
+
+        // filhos primeiro (a arena cresce), entradas do nó depois
+        vector<MTEntry> built(pivots.size());
+        for (size_t j = 0; j < pivots.size(); j++)
         {
-            auto newRoot = make_unique<MTNode>(node->obj, false);
-            newRoot->children.push_back(move(root));
-            newRoot->children.push_back(move(newChild));
-            root = move(newRoot);
+            float r;
+            uint32_t child = bulkBuild(groups[j], pivots[j], nodes, entries, gen, r);
+            vector<uint32_t>().swap(groups[j]);
+            float d = pivot == kNoRow ? 0.0f : dist(pivots[j], pivot);
+            built[j] = {pivots[j], r, d, child};
+            radius = max(radius, d + r);
+        }
+
+        uint32_t node = allocNode(nodes, entries, false);
+        copy(built.begin(), built.end(), entries.begin() + (size_t)node * stride_);
+        nodes[node].count = (uint32_t)built.size();
+        return node;
+    }
+
+    // Distribui as entradas entre os pivôs a e b; r recebe os raios de cobertura
+    template <class DistFn>
+    void partition(size_t a, size_t b, size_t n, DistFn &D, const vector<MTEntry> &all,
+                   vector<uint8_t> &side, float r[2]) const
+    {
+        if (params_.partition == MTreePartition::GeneralizedHyperplane)
+        {
+            // empates vão para o lado com menos entradas: com linhas repetidas
+            // o corte "<=" mandava tudo para a, deixando b com uma só entrada
+            // e a construção quadrática
+            size_t fill[2] = {1, 1};
+            side[a] = 0; side[b] = 1;
+            for (size_t i = 0; i < n; i++)
+            {
+                if (i == a || i == b) continue;
+                float da = D(i, a), db = D(i, b);
+                uint8_t s = da < db ? 0 : db < da ? 1 : (fill[1] < fill[0] ? 1 : 0);
+                side[i] = s;
+                fill[s]++;
+            }
         }
         else
         {
-            node->leaf = false;
-            node->children.push_back(make_unique<MTNode>(node->obj, true));
-            node->children.push_back(move(newChild));
+            // cada pivô, na sua vez, leva a entrada livre mais próxima
+            vector<size_t> byA(n), byB(n);
+            for (size_t i = 0; i < n; i++) byA[i] = byB[i] = i;
+            sort(byA.begin(), byA.end(), [&](size_t x, size_t y) { return D(x, a) < D(y, a); });
+            sort(byB.begin(), byB.end(), [&](size_t x, size_t y) { return D(x, b) < D(y, b); });
+            vector<uint8_t> taken(n, 0);
+            taken[a] = taken[b] = 1;
+            side[a] = 0; side[b] = 1;
+            size_t ia = 0, ib = 0, left = n - 2;
+            for (int turn = 0; left > 0; turn ^= 1, left--)
+            {
+                vector<size_t> &order = turn == 0 ? byA : byB;
+                size_t &it = turn == 0 ? ia : ib;
+                while (taken[order[it]]) it++;
+                taken[order[it]] = 1;
+                side[order[it]] = (uint8_t)turn;
+            }
+        }
+
+        r[0] = r[1] = 0.0f;
+        for (size_t i = 0; i < n; i++)
+        {
+            float reach = D(i, side[i] == 0 ? a : b) + all[i].radius;
+            if (reach > r[side[i]]) r[side[i]] = reach;
+        }
+    }
+
+    // 0 = não achou; 1 = removeu; 2 = removeu e o nó ficou vazio.
+    // Só as páginas do caminho até a linha são escritas (e copiadas).
+    int removeRecursive(uint32_t node, uint32_t row, const float *x, bool prune)
+    {
+        const uint32_t n = nodeAt(node).count;
+        if (nodeAt(node).leaf)
+        {
+            for (uint32_t i = 0; i < n; i++)
+                if (entriesOf(node)[i].row == row)
+                    return removeEntry(node, i) ? 1 : 2;
+            return 0;
+        }
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const MTEntry e = entriesOf(node)[i];
+            if (prune && dist(e.row, x) > e.radius)
+                continue;
+            int r = removeRecursive(e.child, row, x, prune);
+            if (r == 0)
+                continue;
+            if (r == 2)
+            {
+                freeNodes_.push_back(e.child);
+                return removeEntry(node, i) ? 1 : 2;
+            }
+            return 1;
         }
+        return 0;
     }
 
-    // Busca recursiva (k=1)
-    void searchRecursive(MTNode *node, const ImageItem &query,
-                         string &bestId, float &bestDist)
+    // Tira a entrada i do nó (a última ocupa o lugar); devolve quantas sobraram
+    uint32_t removeEntry(uint32_t node, uint32_t i)
     {
-        float distToPivot = chiSquareHist(node->obj.histogram, query.histogram);
+        MTNode &nd = mutableNode(node);
+        MTEntry *entries = mutableEntries(node);
+        entries[i] = entries[--nd.count];
+        return nd.count;
+    }
 
-        if (distToPivot < bestDist)
+    void collectRows(uint32_t node, vector<uint32_t> &out) const
+    {
+        const MTEntry *entries = entriesOf(node);
+        for (uint32_t i = 0; i < nodeAt(node).count; i++)
         {
-            bestDist = distToPivot;
-            bestId = node->obj.id;
+            if (nodeAt(node).leaf)
+                out.push_back(entries[i].row);
+            else
+                collectRows(entries[i].child, out);
         }
+    }
 
-        if (node->leaf)
+    // Desce o nó com as consultas `active` (pivotDist[i] = d(consulta i, pivô
+    // do nó), < 0 na raiz). Filhos são visitados em ordem do menor limite
+    // inferior do grupo, cada um só com as consultas que ainda podem melhorar.
+    void groupSearch(uint32_t node, const vector<uint32_t> &active, const vector<float> &pivotDist,
+                     const vector<const float *> &queries, vector<BoundedTopK<float>> &best,
+                     QueryStats *stats) const
+    {
+        statAdd(stats, &QueryStats::nodesVisited);
+        struct Visit
+        {
+            float lowerBound;
+            uint32_t entry;
+            vector<uint32_t> queries;
+            vector<float> dists;
+        };
+        vector<Visit> visits;
+
+        const bool leaf = nodeAt(node).leaf;
+        const MTEntry *entries = entriesOf(node);
+        for (uint32_t i = 0; i < nodeAt(node).count; i++)
         {
-            for (auto &it : node->items)
+            const MTEntry &e = entries[i];
+            Visit v{numeric_limits<float>::infinity(), i, {}, {}};
+            for (size_t a = 0; a < active.size(); a++)
             {
-                float d = chiSquareHist(it.histogram, query.histogram);
-                if (d < bestDist)
+                uint32_t q = active[a];
+                if (parentLowerBound<Distance>(pivotDist[a], e.parentDist, e.radius) > best[q].worst())
+                {
+                    statAdd(stats, &QueryStats::avoided);
+                    continue;
+                }
+                float d = dist(e.row, queries[q]);
+                statAdd(stats, &QueryStats::distances);
+                if (leaf)
+                    best[q].push(e.row, d);
+                else
                 {
-                    bestDist = d;
-                    bestId = it.id;
+                    float lb = subtreeLowerBound<Distance>(d, e.radius);
+                    if (lb <= best[q].worst())
+                    {
+                        v.queries.push_back(q);
+                        v.dists.push_back(d);
+                        v.lowerBound = min(v.lowerBound, lb);
+                    }
                 }
             }
+            if (!v.queries.empty())
+                visits.push_back(move(v));
+            else if (!leaf)
+                statAdd(stats, &QueryStats::subtreesPruned);
         }
-        else
-        {
-            for (auto &child : node->children)
-            {
-                float pivotDist = chiSquareHist(child->obj.histogram, query.histogram);
 
-                // poda
-                if (pivotDist - child->coveringRadius > bestDist)
-                    continue;
+        sort(visits.begin(), visits.end(),
+             [](const Visit &a, const Visit &b) { return a.lowerBound < b.lowerBound; });
+        for (Visit &v : visits)
+        {
+            // os top-k apertaram desde a triagem: refiltra antes de descer
+            const MTEntry &e = entries[v.entry];
+            size_t keep = 0;
+            for (size_t a = 0; a < v.queries.size(); a++)
+                if (subtreeLowerBound<Distance>(v.dists[a], e.radius) <= best[v.queries[a]].worst())
+                {
+                    v.queries[keep] = v.queries[a];
+                    v.dists[keep] = v.dists[a];
+                    keep++;
+                }
+            v.queries.resize(keep);
+            v.dists.resize(keep);
+            if (keep)
+                groupSearch(e.child, v.queries, v.dists, queries, best, stats);
+            else
+                statAdd(stats, &QueryStats::subtreesPruned);
+        }
+    }
 
-                searchRecursive(child.get(), query, bestId, bestDist);
+    // pivotDist = d(query, pivô do nó), < 0 na raiz
+    void rangeRecursive(uint32_t node, float pivotDist, const float *query, float radius,
+                        vector<Neighbor> &out, QueryStats *stats) const
+    {
+        statAdd(stats, &QueryStats::nodesVisited);
+        const MTEntry *entries = entriesOf(node);
+        const MTNode &nd = nodeAt(node);
+        for (uint32_t i = 0; i < nd.count; i++)
+        {
+            const MTEntry &e = entries[i];
+            if (parentLowerBound<Distance>(pivotDist, e.parentDist, e.radius) > radius)
+            {
+                statAdd(stats, &QueryStats::avoided);
+                if (!nd.leaf)
+                    statAdd(stats, &QueryStats::subtreesPruned);
+                continue;
             }
+            float d = dist(e.row, query);
+            statAdd(stats, &QueryStats::distances);
+            if (nd.leaf)
+            {
+                if (d <= radius)
+                    out.push_back({e.row, d});
+            }
+            else if (subtreeLowerBound<Distance>(d, e.radius) <= radius)
+                rangeRecursive(e.child, d, query, radius, out, stats);
+            else
+                statAdd(stats, &QueryStats::subtreesPruned);
         }
     }
 };
+
+// Padrão: raiz do qui-quadrado (métrica, mesma ordenação do qui-quadrado)
+using MTree = BasicMTree<SqrtChiSquareDistance>;
@@ -0,0 +1,113 @@
+// search_mtree_concurrent.hpp — M-Tree com leitores concorrentes e escrita online
+#pragma once
+#include "search_mtree.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - Os leitores consultam um snapshot imutável (shared_ptr<const MTree>)
+       obtido com atomic_load: nunca esperam pelo mutex dos escritores, e o
+       snapshot continua válido enquanto alguém o segurar.
+     - Os escritores (serializados por um mutex) copiam só a tabela de páginas
+       da árvore atual; cada inserção/remoção copia as páginas do caminho
+       raiz-folha que altera (as demais continuam compartilhadas com os
+       snapshots) e a nova versão é publicada com atomic_store. Páginas e
+       snapshots antigos são liberados quando o último leitor os solta
+       (contagem de referências no lugar de épocas).
+     - apply() agrupa várias escritas em uma única versão.
+     - bulkLoad() monta uma árvore nova, sem copiar a atual.
+     - As linhas inseridas precisam existir no FeatureStore (store.add /
+       ingestImages) antes de apply; o store pode crescer com leitores ativos
+       (blocos estáveis, um escritor por vez).
+
+   API:
+     ConcurrentMTree tree(store, params);
+     tree.insert(row); tree.remove(row); tree.apply(inserts, removes);
+     std::vector<Neighbor> v = tree.knn(query, k);   // de qualquer thread
+     ConcurrentMTree::Snapshot s = tree.snapshot();  // várias consultas na mesma versão
+-----------------------------------------------------------------------------*/
+
+template <class Distance>
+class BasicConcurrentMTree
+{
+public:
+    using Tree = BasicMTree<Distance>;
+    using Snapshot = shared_ptr<const Tree>;
+
+    explicit BasicConcurrentMTree(const FeatureStore &store, const MTreeParams &params = {})
+        : store_(store), params_(params), current_(make_shared<const Tree>(store, params)) {}
+
+    // Versão publicada mais recente (leitura sem bloqueio do escritor)
+    Snapshot snapshot() const { return atomic_load(&current_); }
+
+    uint64_t version() const { return version_.load(memory_order_acquire); }
+    size_t size() const { return snapshot()->size(); }
+
+    MTreeSearchResult searchMostSimilar(const float *query, QueryStats *stats = nullptr) const
+    {
+        return snapshot()->searchMostSimilar(query, stats);
+    }
+
+    vector<Neighbor> knn(const float *query, size_t k, QueryStats *stats = nullptr) const
+    {
+        return snapshot()->knn(query, k, stats);
+    }
+
+    vector<vector<Neighbor>> searchBatch(const vector<const float *> &queries, size_t k,
+                                         QueryStats *stats = nullptr) const
+    {
+        return snapshot()->searchBatch(queries, k, stats);
+    }
+
+    vector<Neighbor> range(const float *query, float radius, QueryStats *stats = nullptr) const
+    {
+        return snapshot()->range(query, radius, stats);
+    }
+
+    void insert(uint32_t row) { apply({row}, {}); }
+
+    bool remove(uint32_t row) { return apply({}, {row}) == 1; }
+
+    // Uma nova versão com todas as remoções e inserções; retorna quantas
+    // remoções acharam a linha
+    size_t apply(const vector<uint32_t> &inserts, const vector<uint32_t> &removes)
+    {
+        lock_guard<mutex> lock(writer_);
+        auto next = make_shared<Tree>(*current_); // só a tabela de páginas
+        size_t removed = 0;
+        for (uint32_t row : removes)
+            removed += next->remove(row) ? 1 : 0;
+        next->reserve(next->size() + inserts.size());
+        for (uint32_t row : inserts)
+            next->insert(row);
+        publish(move(next));
+        return removed;
+    }
+
+    // Reconstrói tudo com bulkLoad e publica de uma vez
+    void bulkLoad(const vector<uint32_t> &rows, int threads = defaultThreadCount())
+    {
+        lock_guard<mutex> lock(writer_);
+        auto next = make_shared<Tree>(store_, params_);
+        next->bulkLoad(rows, threads);
+        publish(move(next));
+    }
+
+private:
+    void publish(shared_ptr<Tree> next)
+    {
+        atomic_store(&current_, Snapshot(move(next)));
+        version_.fetch_add(1, memory_order_release);
+    }
+
+    const FeatureStore &store_;
+    const MTreeParams params_;
+    mutex writer_;
+    Snapshot current_;
+    atomic<uint64_t> version_{0};
+};
+
+using ConcurrentMTree = BasicConcurrentMTree<SqrtChiSquareDistance>;
@@ -1,15 +1,20 @@
 #pragma once
-#include "image_item.hpp"
+#include "feature_store.hpp"
+#include "distance_policy.hpp"
+#include "top_k.hpp"
+#include "query_stats.hpp"
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <string>
 #include <iostream>
 #include <limits>
+#include <queue>
 #include <cmath>
 using namespace std;
 
 // Converte histograma para ponto 2D (R,G médios)
-inline pair<float,float> histogramToPoint(const vector<float>& hist) {
+inline pair<float,float> histogramToPoint(const float* hist) {
     int bins = 8; // mesmo usado na main
     float sumR=0, sumG=0, total=0;
 
@@ -28,79 +33,73 @@ inline pair<float,float> histogramToPoint(const vector<float>& hist) {
     return {sumR/total / bins, sumG/total / bins}; // normaliza para [0,1]
 }
 
-// Distância qui-quadrado entre histogramas
-inline float chiSquare(const vector<float>& h1, const vector<float>& h2) {
-    float sum = 0.0f;
-    for (size_t i = 0; i < h1.size(); i++) {
-        float denom = h1[i] + h2[i];
-        if (denom != 0.0f) {
-            float diff = h1[i] - h2[i];
-            sum += (diff * diff) / denom;
-        }
-    }
-    return sum;
+// Limite inferior da distância a partir dos pontos 2D (maior diferença por eixo);
+// a derivação de cada política está em distance_policy.hpp. Vale para
+// histogramas normalizados, que é o que computeRGBHistogram produz.
+template <class Distance = ChiSquareDistance>
+inline float quadtreeLowerBound(float dx, float dy) {
+    return Distance::pointLowerBound(dx > dy ? dx : dy);
 }
 
-// Nó da Quadtree
+// Nó da Quadtree: itens só nas folhas
 class QuadtreeNode {
 public:
     float xMin, xMax, yMin, yMax;   // limites do quadrante
-    vector<ImageItem> items;        // imagens armazenadas
+    vector<uint32_t> items;         // linhas do FeatureStore (somente em folhas)
+    vector<pair<float,float>> pontos; // ponto 2D de cada item (mesma ordem)
     unique_ptr<QuadtreeNode> NE, NO, SE, SO;
     bool subdividido = false;
-    int capacidade;
 
-    QuadtreeNode(float xMin_, float xMax_, float yMin_, float yMax_, int cap = 2)
-        : xMin(xMin_), xMax(xMax_), yMin(yMin_), yMax(yMax_), capacidade(cap) {}
+    QuadtreeNode(float xMin_, float xMax_, float yMin_, float yMax_)
+        : xMin(xMin_), xMax(xMax_), yMin(yMin_), yMax(yMax_) {}
 
     bool contem(const pair<float,float>& p) const {
         return (p.first >= xMin && p.first < xMax &&
                 p.second >= yMin && p.second < yMax);
     }
 
+    // Distância (por eixo) do ponto ao retângulo do nó; 0 se estiver dentro
+    float distX(float x) const { return x < xMin ? xMin - x : (x > xMax ? x - xMax : 0.0f); }
+    float distY(float y) const { return y < yMin ? yMin - y : (y > yMax ? y - yMax : 0.0f); }
+
     void subdividir() {
         float xMid = (xMin + xMax) / 2.0f;
         float yMid = (yMin + yMax) / 2.0f;
 
-        NE = make_unique<QuadtreeNode>(xMid, xMax, yMid, yMax, capacidade);
-        NO = make_unique<QuadtreeNode>(xMin, xMid, yMid, yMax, capacidade);
-        SE = make_unique<QuadtreeNode>(xMid, xMax, yMin, yMid, capacidade);
-        SO = make_unique<QuadtreeNode>(xMin, xMid, yMin, yMid, capacidade);
+        NE = make_unique<QuadtreeNode>(xMid, xMax, yMid, yMax);
+        NO = make_unique<QuadtreeNode>(xMin, xMid, yMid, yMax);
+        SE = make_unique<QuadtreeNode>(xMid, xMax, yMin, yMid);
+        SO = make_unique<QuadtreeNode>(xMin, xMid, yMin, yMid);
 
         subdividido = true;
     }
 
-    void inserir(const ImageItem& img) {
-        auto p = histogramToPoint(img.histogram);
-        if (!contem(p)) return;
-
-        if (items.size() < (size_t)capacidade) {
-            items.push_back(img);
-        } else {
-            if (!subdividido) subdividir();
-            NE->inserir(img);
-            NO->inserir(img);
-            SE->inserir(img);
-            SO->inserir(img);
-        }
+    // Quadrante filho que contém o ponto (pelo meio, sem ambiguidade na borda)
+    QuadtreeNode* filho(const pair<float,float>& p) const {
+        float xMid = (xMin + xMax) / 2.0f;
+        float yMid = (yMin + yMax) / 2.0f;
+        if (p.second >= yMid) return p.first >= xMid ? NE.get() : NO.get();
+        return p.first >= xMid ? SE.get() : SO.get();
     }
 
-    void buscar(const pair<float,float>& queryPoint, const ImageItem& query,
-                string& bestId, float& bestDist) const {
-        // Verifica itens neste nó
-        for (auto& it : items) {
-            float d = chiSquare(it.histogram, query.histogram);
-            if (d < bestDist) {
-                bestDist = d;
-                bestId = it.id;
-            }
+    void inserir(uint32_t img, const pair<float,float>& p, int capacidade, int profundidade) {
+        if (subdividido) {
+            filho(p)->inserir(img, p, capacidade, profundidade - 1);
+            return;
         }
+        items.push_back(img);
+        pontos.push_back(p);
 
-        if (subdividido) {
-            if (NE->contem(queryPoint)) NE->buscar(queryPoint, query, bestId, bestDist);
-            else if (NO->contem(queryPoint)) NO->buscar(queryPoint, query, bestId, bestDist);
-            else if (SE->contem(queryPoint)) SE->buscar(queryPoint, query, bestId, bestDist);
-            else if (SO->contem(queryPoint)) SO->buscar(queryPoint, query, bestId, bestDist);
+        // folha cheia: desce os itens para os quadrantes (profundidade limita
+        // pontos repetidos, que nunca se separariam)
+        if (items.size() > (size_t)capacidade && profundidade > 0) {
+            subdividir();
+            for (size_t i = 0; i < items.size(); i++)
+                filho(pontos[i])->inserir(items[i], pontos[i], capacidade, profundidade - 1);
+            items.clear();
+            items.shrink_to_fit();
+            pontos.clear();
+            pontos.shrink_to_fit();
         }
     }
 };
@@ -108,30 +107,173 @@ public:
 // Resultado da busca
 class QuadtreeSearchResult {
 public:
-    string id;
+    uint32_t row;       // linha no FeatureStore (kNoRow se nada foi encontrado)
     float distance;
 
-    QuadtreeSearchResult(string id_, float dist_) : id(id_), distance(dist_) {}
+    QuadtreeSearchResult(uint32_t row_, float dist_) : row(row_), distance(dist_) {}
 
-    void print() {
+    void print(const FeatureStore& store) {
         cout << "-> Imagem mais similar encontrada:" << endl;
-        cout << id << " | dist = " << distance << endl;
+        if (row == kNoRow) { cout << "Nenhum item encontrado." << endl; return; }
+        cout << store.id(row) << " | dist = " << distance << endl;
     }
 };
 
-// Função principal de busca
-inline QuadtreeSearchResult searchMostSimilarQuadtree(vector<ImageItem>& index, ImageItem& queryImage) {
-    QuadtreeNode root(0.0f, 1.0f, 0.0f, 1.0f); // limites normalizados
+// Quadtree construída uma vez e consultada muitas vezes.
+// Busca best-first: os nós saem da fila em ordem do limite inferior da distância
+// do ponto da consulta ao quadrante; a busca para quando o limite do próximo nó já
+// não bate a k-ésima melhor distância encontrada, o que dá os vizinhos exatos.
+template <class Distance = ChiSquareDistance>
+class BasicQuadtreeIndex {
+public:
+    using distance_type = Distance;
+
+    explicit BasicQuadtreeIndex(const FeatureStore& store_, int capacidadeFolha = 8, int profundidadeMax = 16)
+        : store(store_), capacidade(capacidadeFolha < 1 ? 1 : capacidadeFolha),
+          profundidadeMax(profundidadeMax), root(0.0f, 1.0f, 0.0f, 1.0f) {} // limites normalizados
 
-    for (auto& img : index) {
-        root.inserir(img);
+    void insert(uint32_t row) {
+        root.inserir(row, histogramToPoint(store.row(row)), capacidade, profundidadeMax);
+        count++;
     }
 
-    string bestId = "";
-    float bestDist = numeric_limits<float>::infinity();
-    auto queryPoint = histogramToPoint(queryImage.histogram);
+    void build(const vector<uint32_t>& rows) {
+        for (uint32_t row : rows) insert(row);
+    }
 
-    root.buscar(queryPoint, queryImage, bestId, bestDist);
+    size_t size() const { return count; }
 
-    return QuadtreeSearchResult(bestId, bestDist);
-}
+    // Bytes dos nós e dos vetores das folhas (capacidade reservada incluída)
+    size_t memoryBytes() const { return sizeof(*this) - sizeof(root) + nodeBytes(&root); }
+
+    QuadtreeSearchResult searchMostSimilar(const float* query, QueryStats* stats = nullptr) const {
+        vector<Neighbor> hit = knn(query, 1, stats);
+        if (hit.empty()) return QuadtreeSearchResult(kNoRow, numeric_limits<float>::infinity());
+        return QuadtreeSearchResult(hit[0].row, hit[0].distance);
+    }
+
+    // k vizinhos exatos: mesma busca best-first, podando pela k-ésima distância
+    vector<Neighbor> knn(const float* query, size_t k, QueryStats* stats = nullptr) const {
+        QueryTimer timer(stats, QueryPhase::Total);
+        BoundedTopK<float> best(k);
+        if (k == 0) return best.sorted();
+        auto q = histogramToPoint(query);
+
+        using Entrada = pair<float, const QuadtreeNode*>;
+        priority_queue<Entrada, vector<Entrada>, greater<Entrada>> fila;
+        fila.push({0.0f, &root});
+
+        while (!fila.empty()) {
+            auto [limite, node] = fila.top();
+            fila.pop();
+            if (limite >= best.worst()) { // nenhum nó restante pode melhorar
+                statAdd(stats, &QueryStats::subtreesPruned, fila.size() + 1);
+                break;
+            }
+            statAdd(stats, &QueryStats::nodesVisited);
+
+            if (!node->subdividido) {
+                for (size_t i = 0; i < node->items.size(); i++) {
+                    const auto& p = node->pontos[i];
+                    if (quadtreeLowerBound<Distance>(fabs(p.first - q.first), fabs(p.second - q.second)) >= best.worst()) {
+                        statAdd(stats, &QueryStats::avoided);
+                        continue;
+                    }
+                    statAdd(stats, &QueryStats::distances);
+                    best.push(node->items[i], Distance::eval(store.row(node->items[i]), query, store.dims()));
+                }
+                continue;
+            }
+
+            for (const QuadtreeNode* c : {node->NE.get(), node->NO.get(), node->SE.get(), node->SO.get()}) {
+                float lb = quadtreeLowerBound<Distance>(c->distX(q.first), c->distY(q.second));
+                if (lb < best.worst()) fila.push({lb, c});
+                else statAdd(stats, &QueryStats::subtreesPruned);
+            }
+        }
+        return best.sorted();
+    }
+
+    // k-NN de várias consultas: o grupo desce a árvore junto (cada folha é
+    // lida uma vez para todas as consultas que ainda podem melhorar nela)
+    vector<vector<Neighbor>> searchBatch(const vector<const float*>& queries, size_t k,
+                                         QueryStats* stats = nullptr) const {
+        QueryTimer timer(stats, QueryPhase::Total);
+        vector<BoundedTopK<float>> best(queries.size(), BoundedTopK<float>(k));
+        vector<pair<float,float>> pts(queries.size());
+        for (size_t q = 0; q < queries.size(); q++) pts[q] = histogramToPoint(queries[q]);
+
+        if (k > 0) {
+            const size_t grupo = 16;
+            for (size_t q0 = 0; q0 < queries.size(); q0 += grupo) {
+                vector<uint32_t> ativas;
+                for (size_t q = q0; q < min(queries.size(), q0 + grupo); q++) ativas.push_back((uint32_t)q);
+                buscaGrupo(&root, ativas, queries, pts, best, stats);
+            }
+        }
+        vector<vector<Neighbor>> out(queries.size());
+        for (size_t q = 0; q < queries.size(); q++) out[q] = best[q].sorted();
+        return out;
+    }
+
+private:
+    static size_t nodeBytes(const QuadtreeNode* node) {
+        size_t bytes = sizeof(QuadtreeNode) + node->items.capacity() * sizeof(uint32_t)
+                     + node->pontos.capacity() * sizeof(pair<float,float>);
+        if (node->subdividido)
+            for (const QuadtreeNode* c : {node->NE.get(), node->NO.get(), node->SE.get(), node->SO.get()})
+                bytes += nodeBytes(c);
+        return bytes;
+    }
+
+    void buscaGrupo(const QuadtreeNode* node, const vector<uint32_t>& ativas,
+                    const vector<const float*>& queries, const vector<pair<float,float>>& pts,
+                    vector<BoundedTopK<float>>& best, QueryStats* stats) const {
+        statAdd(stats, &QueryStats::nodesVisited);
+        if (!node->subdividido) {
+            for (size_t i = 0; i < node->items.size(); i++) {
+                const float* row = store.row(node->items[i]);
+                const auto& p = node->pontos[i];
+                for (uint32_t q : ativas) {
+                    if (quadtreeLowerBound<Distance>(fabs(p.first - pts[q].first), fabs(p.second - pts[q].second)) >= best[q].worst()) {
+                        statAdd(stats, &QueryStats::avoided);
+                        continue;
+                    }
+                    statAdd(stats, &QueryStats::distances);
+                    best[q].push(node->items[i], Distance::eval(row, queries[q], store.dims()));
+                }
+            }
+            return;
+        }
+
+        // quadrantes em ordem do menor limite do grupo, cada um com as consultas que ainda precisam dele
+        pair<float, const QuadtreeNode*> filhos[4];
+        int n = 0;
+        for (const QuadtreeNode* c : {node->NE.get(), node->NO.get(), node->SE.get(), node->SO.get()}) {
+            float menor = numeric_limits<float>::infinity();
+            for (uint32_t q : ativas)
+                menor = min(menor, quadtreeLowerBound<Distance>(c->distX(pts[q].first), c->distY(pts[q].second)));
+            filhos[n++] = {menor, c};
+        }
+        sort(filhos, filhos + n, [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        vector<uint32_t> sub;
+        for (int f = 0; f < n; f++) {
+            const QuadtreeNode* c = filhos[f].second;
+            sub.clear();
+            for (uint32_t q : ativas)
+                if (quadtreeLowerBound<Distance>(c->distX(pts[q].first), c->distY(pts[q].second)) < best[q].worst())
+                    sub.push_back(q);
+            if (!sub.empty()) buscaGrupo(c, sub, queries, pts, best, stats);
+            else statAdd(stats, &QueryStats::subtreesPruned);
+        }
+    }
+
+    const FeatureStore& store;
+    int capacidade;
+    int profundidadeMax;
+    size_t count = 0;
+    QuadtreeNode root;
+};
+
+using QuadtreeIndex = BasicQuadtreeIndex<ChiSquareDistance>;
@@ -0,0 +1,455 @@
+// sparse_store.hpp — histogramas esparsos (máscara de 512 bits + valores compactados)
+#pragma once
+#include "feature_store.hpp"
+#include "distance.hpp"
+#include "distance_policy.hpp"
+#include "query_stats.hpp"
+#include "search_mtree.hpp"
+#include "thread_pool.hpp"
+#include "top_k.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - Uma foto típica ocupa poucas dezenas ou centenas dos 512 bins 8x8x8 (as
+       imagens de images/ têm em média 132, de 8 a 352). Cada linha esparsa
+       guarda uma máscara de 512 bits dos bins não nulos e, em um bloco só,
+       os valores desses bins seguidos dos índices (uint16, em ordem):
+       64 B + 6 B por bin, contra 2 KB da linha float.
+     - A escolha é por linha, na codificação: densidade (bins não nulos / dims)
+       até maxDensity vira esparsa, acima continua densa (512 floats, kernel
+       denso de distance.hpp). O padrão depende do kernel da máquina.
+     - O qui-quadrado só trabalha na união dos bins não nulos, e só a
+       interseção das máscaras tem divisão (ver "kernels" abaixo). Contra a
+       consulta densa, os valores dela nos bins da linha vêm por gather com
+       os índices, em blocos cheios de 8/16 sem desvio por bloco; entre duas
+       linhas esparsas, os blocos de bins com interseção vazia nas máscaras
+       são pulados e os demais expandidos (vexpandps no AVX-512, permutação
+       por tabela no AVX2, ctz + popcount no scalar).
+
+   API:
+     SparseStore s = SparseStore::encode(store);          // escolha por linha
+     float d = s.chiSquare(row, SparseQuery(query, dims)); // consulta float densa
+     std::vector<Neighbor> v = searchKnnSparse(s, index, query, k);
+     BasicMTree<SqrtChiSquareDistance, SparseStore> tree(s);   // M-Tree esparsa
+-----------------------------------------------------------------------------*/
+
+static constexpr size_t kSparseMaxDims = 512;
+static constexpr size_t kSparseMaskWords = kSparseMaxDims / 64;
+
+// Uma linha vista pelos kernels: máscara e índices dos bins não nulos,
+// valores (compactados em ordem de bin, ou os dims floats se dense) e a soma deles
+struct SparseRow
+{
+    const uint64_t* mask;
+    const uint16_t* index;   // nullptr se dense
+    const float* values;
+    uint32_t nnz;
+    float sum;
+    bool dense;
+};
+
+// ---- kernels ---------------------------------------------------------------
+//
+// Com (a-b)^2/(a+b) = a + b - 4ab/(a+b), o qui-quadrado vira
+//   chi2(a, b) = soma(a) + soma(b) - 4 * soma_{i em A∩B} a_i b_i / (a_i + b_i)
+// em que A e B são os bins não nulos: só a interseção das máscaras tem
+// divisão, o resto da união entra pelas somas. A subtração perde precisão
+// quando a distância é muito pequena (erro absoluto ~1e-7 com somas ~1);
+// resultados negativos do arredondamento viram 0.
+
+inline float sparseChiSquareDenseScalar(const SparseRow& a, const float* b, float sumB, size_t) {
+    float inter = 0.0f;
+    for (uint32_t j = 0; j < a.nnz; j++) {
+        float x = a.values[j], y = b[a.index[j]];
+        inter += x * y / (x + y);   // x > 0
+    }
+    return std::max(0.0f, a.sum + sumB - 4.0f * inter);
+}
+
+inline float sparseSumScalar(const float* q, size_t dims) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < dims; i++) sum += q[i];
+    return sum;
+}
+
+inline float sparseChiSquareSparseScalar(const SparseRow& a, const SparseRow& b, size_t dims) {
+    const float* pa = a.values;
+    const float* pb = b.values;
+    float inter = 0.0f;
+    for (size_t w = 0; w * 64 < dims; w++) {
+        const uint64_t ma = a.mask[w], mb = b.mask[w];
+        for (uint64_t m = ma & mb; m; m &= m - 1) {
+            const uint64_t below = (m & (0 - m)) - 1;
+            float x = pa[__builtin_popcountll(ma & below)], y = pb[__builtin_popcountll(mb & below)];
+            inter += x * y / (x + y);
+        }
+        pa += __builtin_popcountll(ma);
+        pb += __builtin_popcountll(mb);
+    }
+    return std::max(0.0f, a.sum + b.sum - 4.0f * inter);
+}
+
+#ifdef PAA_X86_SIMD
+
+// Soma da consulta (por chamada quando a M-Tree passa só o ponteiro); dims múltiplo de 16
+__attribute__((target("avx512f")))
+inline float sparseSumAVX512(const float* q, size_t dims) {
+    __m512 acc = _mm512_setzero_ps();
+    for (size_t i = 0; i < dims; i += 16) acc = _mm512_add_ps(acc, _mm512_loadu_ps(q + i));
+    return paaHsum512(acc);
+}
+
+// Consulta densa: os valores dela nos bins da linha vêm por gather, 16 por
+// vez (o índice lê além do fim da linha: o store deixa folga nos índices)
+__attribute__((target("avx512f,popcnt")))
+inline float sparseChiSquareDenseAVX512(const SparseRow& a, const float* b, float sumB, size_t) {
+    __m512 inter = _mm512_setzero_ps();
+    for (uint32_t j = 0; j < a.nnz; j += 16) {
+        const __mmask16 m = a.nnz - j >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (a.nnz - j)) - 1);
+        const __m512i idx = _mm512_maskz_cvtepu16_epi32(m, _mm256_loadu_si256((const __m256i*)(a.index + j)));
+        const __m512 x = _mm512_maskz_loadu_ps(m, a.values + j);
+        const __m512 y = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), m, idx, b, 4);
+        inter = _mm512_mask_add_ps(inter, m, inter, _mm512_maskz_div_ps(m, _mm512_mul_ps(x, y), _mm512_add_ps(x, y)));
+    }
+    return std::max(0.0f, a.sum + sumB - 4.0f * paaHsum512(inter));
+}
+
+// Duas linhas esparsas: só os blocos de 16 com interseção não vazia são expandidos
+__attribute__((target("avx512f,popcnt")))
+inline float sparseChiSquareSparseAVX512(const SparseRow& a, const SparseRow& b, size_t dims) {
+    const float* pa = a.values;
+    const float* pb = b.values;
+    __m512 inter = _mm512_setzero_ps();
+    for (size_t c = 0; c * 16 < dims; c++) {
+        const __mmask16 ka = (__mmask16)(a.mask[c >> 2] >> ((c & 3) * 16));
+        const __mmask16 kb = (__mmask16)(b.mask[c >> 2] >> ((c & 3) * 16));
+        const __mmask16 ki = ka & kb;
+        if (ki) {
+            const __m512 x = _mm512_maskz_expandloadu_ps(ka, pa), y = _mm512_maskz_expandloadu_ps(kb, pb);
+            inter = _mm512_mask_add_ps(inter, ki, inter, _mm512_maskz_div_ps(ki, _mm512_mul_ps(x, y), _mm512_add_ps(x, y)));
+        }
+        pa += __builtin_popcount(ka);
+        pb += __builtin_popcount(kb);
+    }
+    return std::max(0.0f, a.sum + b.sum - 4.0f * paaHsum512(inter));
+}
+
+// Permutação por byte de máscara para o AVX2 (não tem vexpandps): a lane j
+// recebe o valor compactado de posição popcount(bits da máscara abaixo de j)
+struct SparseExpandTable
+{
+    alignas(32) int32_t index[256][8];
+
+    SparseExpandTable() {
+        for (int m = 0; m < 256; m++)
+            for (int j = 0, rank = 0; j < 8; j++) {
+                index[m][j] = rank;
+                if (m >> j & 1) rank++;
+            }
+    }
+};
+
+inline const SparseExpandTable& sparseExpandTable() {
+    static const SparseExpandTable table;
+    return table;
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256 sparseLaneMask(unsigned m) {
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)m), bits), bits));
+}
+
+__attribute__((target("avx2,fma")))
+inline float sparseSumAVX2(const float* q, size_t dims) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    for (size_t i = 0; i < dims; i += 16) {
+        acc0 = _mm256_add_ps(acc0, _mm256_loadu_ps(q + i));
+        acc1 = _mm256_add_ps(acc1, _mm256_loadu_ps(q + i + 8));
+    }
+    return paaHsum256(_mm256_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx2,fma")))
+inline float sparseChiSquareDenseAVX2(const SparseRow& a, const float* b, float sumB, size_t) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 inter = _mm256_setzero_ps();
+    for (uint32_t j = 0; j < a.nnz; j += 8) {
+        const __m256 m = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32((int)(a.nnz - j)), lanes));
+        const __m256i idx = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(a.index + j)));
+        const __m256 x = _mm256_loadu_ps(a.values + j);   // além de nnz: índices da linha ou folga
+        const __m256 y = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), b, idx, m, 4);
+        inter = _mm256_add_ps(inter, _mm256_and_ps(m, _mm256_div_ps(_mm256_mul_ps(x, y), _mm256_add_ps(x, y))));
+    }
+    return std::max(0.0f, a.sum + sumB - 4.0f * paaHsum256(inter));
+}
+
+__attribute__((target("avx2,fma,popcnt")))
+inline float sparseChiSquareSparseAVX2(const SparseRow& a, const SparseRow& b, size_t dims) {
+    const SparseExpandTable& t = sparseExpandTable();
+    const float* pa = a.values;
+    const float* pb = b.values;
+    __m256 inter = _mm256_setzero_ps();
+    for (size_t c = 0; c * 8 < dims; c++) {
+        const unsigned ka = (unsigned)(a.mask[c >> 3] >> ((c & 7) * 8)) & 0xFF;
+        const unsigned kb = (unsigned)(b.mask[c >> 3] >> ((c & 7) * 8)) & 0xFF;
+        if (ka & kb) {
+            // lê 8 floats a partir de pa/pb: o store deixa folga no fim do bloco
+            const __m256 x = _mm256_permutevar8x32_ps(_mm256_loadu_ps(pa), _mm256_load_si256((const __m256i*)t.index[ka]));
+            const __m256 y = _mm256_permutevar8x32_ps(_mm256_loadu_ps(pb), _mm256_load_si256((const __m256i*)t.index[kb]));
+            const __m256 term = _mm256_div_ps(_mm256_mul_ps(x, y), _mm256_add_ps(x, y));
+            inter = _mm256_add_ps(inter, _mm256_and_ps(sparseLaneMask(ka & kb), term));
+        }
+        pa += __builtin_popcount(ka);
+        pb += __builtin_popcount(kb);
+    }
+    return std::max(0.0f, a.sum + b.sum - 4.0f * paaHsum256(inter));
+}
+
+#endif // PAA_X86_SIMD
+
+using SparseDenseFn = float (*)(const SparseRow&, const float*, float, size_t);
+using SparseSparseFn = float (*)(const SparseRow&, const SparseRow&, size_t);
+using SparseSumFn = float (*)(const float*, size_t);
+
+struct SparseKernels
+{
+    SparseDenseFn dense;
+    SparseSparseFn sparse;
+    SparseSumFn sum;
+    float defaultDensity;   // acima disso a linha densa é mais rápida com este kernel
+};
+
+// Kernels de uma ISA (SSE usa o scalar). Limites medidos contra o kernel
+// denso da mesma ISA (linha esparsa x consulta densa, 512 bins): o AVX-512
+// empata perto de 320 bins não nulos, o AVX2 perto de 384 e o scalar esparso
+// sempre ganha do denso com desvio por bin. Acima de ~330 bins a linha
+// esparsa (64 B + 6 B por bin) também deixa de ser menor que a densa.
+inline SparseKernels sparseKernels(DistanceIsa isa) {
+#ifdef PAA_X86_SIMD
+    if (isa == DistanceIsa::AVX512)
+        return {sparseChiSquareDenseAVX512, sparseChiSquareSparseAVX512, sparseSumAVX512, 0.6f};
+    if (isa == DistanceIsa::AVX2)
+        return {sparseChiSquareDenseAVX2, sparseChiSquareSparseAVX2, sparseSumAVX2, 0.7f};
+#else
+    (void)isa;
+#endif
+    return {sparseChiSquareDenseScalar, sparseChiSquareSparseScalar, sparseSumScalar, 0.75f};
+}
+
+inline const SparseKernels& sparseKernelsDispatch() {
+    static const SparseKernels kernels = sparseKernels(detectDistanceIsa());
+    return kernels;
+}
+
+// Consulta densa com a soma já calculada (uma vez por consulta, não por linha)
+struct SparseQuery
+{
+    const float* values;
+    float sum;
+
+    SparseQuery(const float* q, size_t dims) : values(q), sum(sparseKernelsDispatch().sum(q, dims)) {}
+};
+
+// ---- store ---------------------------------------------------------------
+
+class SparseStore {
+public:
+    // maxDensity < 0: limite padrão do kernel da máquina; 0: tudo denso; 1: tudo esparso
+    explicit SparseStore(size_t dims = FeatureStore::kDims, float maxDensity = -1.0f)
+        : dims_(dims), kernels_(sparseKernelsDispatch()),
+          maxDensity_(maxDensity < 0.0f ? kernels_.defaultDensity : maxDensity) {
+        if (dims > kSparseMaxDims || dims % 16) throw std::invalid_argument("SparseStore: dims deve ser multiplo de 16 e <= 512");
+    }
+
+    // Todas as linhas do store, na mesma numeração
+    static SparseStore encode(const FeatureStore& store, float maxDensity = -1.0f) {
+        SparseStore s(store.dims(), maxDensity);
+        s.rows_.reserve(store.size());
+        s.masks_.reserve((size_t)store.size() * kSparseMaskWords);
+        for (uint32_t r = 0; r < store.size(); r++) s.add(store.row(r));
+        s.shrink();
+        return s;
+    }
+
+    uint32_t add(const float* hist) {
+        uint64_t mask[kSparseMaskWords] = {};
+        uint32_t nnz = 0;
+        float sum = 0.0f;
+        for (size_t i = 0; i < dims_; i++)
+            if (hist[i] != 0.0f) { mask[i >> 6] |= 1ULL << (i & 63); nnz++; sum += hist[i]; }
+        const bool dense = nnz > maxDensity_ * dims_;
+
+        // esparsa: nnz valores seguidos dos nnz índices (um bloco só por linha);
+        // densa: dims floats alinhados a 64 B
+        size_t offset = dense ? (used_ + FeatureStore::kAlign - 1) / FeatureStore::kAlign * FeatureStore::kAlign : used_;
+        size_t bytes = dense ? dims_ * sizeof(float) : (nnz * (sizeof(float) + sizeof(uint16_t)) + 3) / 4 * 4;
+        reserveBytes(offset + bytes);
+        unsigned char* p = data_.get() + offset;
+        if (dense) std::memcpy(p, hist, bytes);
+        else {
+            float* values = reinterpret_cast<float*>(p);
+            uint16_t* index = reinterpret_cast<uint16_t*>(values + nnz);
+            for (size_t i = 0, j = 0; i < dims_; i++)
+                if (hist[i] != 0.0f) { values[j] = hist[i]; index[j++] = (uint16_t)i; }
+        }
+        used_ = offset + bytes;
+
+        rows_.push_back({offset, sum, nnz, dense});
+        masks_.insert(masks_.end(), mask, mask + kSparseMaskWords);
+        if (!dense) sparseRows_++;
+        return (uint32_t)rows_.size() - 1;
+    }
+
+    uint32_t size() const { return (uint32_t)rows_.size(); }
+    size_t dims() const { return dims_; }
+    float maxDensity() const { return maxDensity_; }
+    uint32_t sparseRows() const { return sparseRows_; }
+    size_t nonZeros(uint32_t r) const { return rows_[r].nnz; }
+    bool isDense(uint32_t r) const { return rows_[r].dense; }
+
+    // Bytes ocupados (valores e índices, máscaras e a descrição de cada linha)
+    size_t memoryBytes() const {
+        return capacity_ + masks_.capacity() * sizeof(uint64_t) + rows_.capacity() * sizeof(RowInfo);
+    }
+
+    SparseRow row(uint32_t r) const {
+        const RowInfo& info = rows_[r];
+        const float* values = reinterpret_cast<const float*>(data_.get() + info.offset);
+        return {masks_.data() + (size_t)r * kSparseMaskWords,
+                info.dense ? nullptr : reinterpret_cast<const uint16_t*>(values + info.nnz),
+                values, info.nnz, info.sum, info.dense};
+    }
+
+    // chi2(linha, consulta float densa)
+    float chiSquare(uint32_t r, const SparseQuery& query) const {
+        SparseRow a = row(r);
+        // o gather depende do índice lido: pede o bloco todo antes (acesso
+        // aleatório da M-Tree; na varredura sequencial o prefetcher já cobre)
+        if (!a.dense)
+            for (size_t off = 0; off < a.nnz * (sizeof(float) + sizeof(uint16_t)); off += 64)
+                __builtin_prefetch(reinterpret_cast<const char*>(a.values) + off);
+        return a.dense ? chiSquareDist(a.values, query.values, dims_) : kernels_.dense(a, query.values, query.sum, dims_);
+    }
+
+    float chiSquare(uint32_t r, const float* query) const { return chiSquare(r, SparseQuery(query, dims_)); }
+
+    // chi2 entre duas linhas do store
+    float chiSquare(uint32_t r, uint32_t other) const {
+        SparseRow a = row(r), b = row(other);
+        if (a.dense && b.dense) return chiSquareDist(a.values, b.values, dims_);
+        if (a.dense) return kernels_.dense(b, a.values, a.sum, dims_);
+        if (b.dense) return kernels_.dense(a, b.values, b.sum, dims_);
+        return kernels_.sparse(a, b, dims_);
+    }
+
+    void decode(uint32_t r, float* out) const {
+        SparseRow a = row(r);
+        if (a.dense) { std::memcpy(out, a.values, dims_ * sizeof(float)); return; }
+        std::fill(out, out + dims_, 0.0f);
+        for (uint32_t j = 0; j < a.nnz; j++) out[a.index[j]] = a.values[j];
+    }
+
+private:
+    // Folga no fim do bloco: os kernels leem até 16 índices / 8 valores além da linha
+    static constexpr size_t kSlackBytes = 64;
+
+    struct RowInfo
+    {
+        size_t offset;   // byte inicial da linha em data_
+        float sum;       // soma dos valores (entra no chi2 esparso)
+        uint32_t nnz;
+        bool dense;
+    };
+
+    struct FreeDeleter { void operator()(unsigned char* p) const { std::free(p); } };
+
+    void reserveBytes(size_t used) {
+        if (used + kSlackBytes <= capacity_) return;
+        size_t cap = std::max(used + kSlackBytes, capacity_ ? capacity_ * 2 : size_t(64 * 1024));
+        regrow(cap);
+    }
+
+    void shrink() {
+        if (used_ + kSlackBytes < capacity_) regrow(used_ + kSlackBytes);
+    }
+
+    void regrow(size_t cap) {
+        cap = (cap + FeatureStore::kAlign - 1) / FeatureStore::kAlign * FeatureStore::kAlign;
+        unsigned char* fresh = static_cast<unsigned char*>(std::aligned_alloc(FeatureStore::kAlign, cap));
+        if (!fresh) throw std::bad_alloc();
+        if (used_) std::memcpy(fresh, data_.get(), used_);
+        std::memset(fresh + used_, 0, cap - used_);   // folga lida pelos kernels: zeros
+        data_.reset(fresh);
+        capacity_ = cap;
+    }
+
+    size_t dims_;
+    SparseKernels kernels_;
+    float maxDensity_;
+    std::unique_ptr<unsigned char, FreeDeleter> data_;   // linhas, alinhado a 64 B
+    size_t used_ = 0, capacity_ = 0;
+    std::vector<uint64_t> masks_;   // kSparseMaskWords por linha
+    std::vector<RowInfo> rows_;
+    uint32_t sparseRows_ = 0;
+};
+
+// ---- M-Tree sobre linhas esparsas (ver rowDistance em search_mtree.hpp) ----
+
+template <class Distance>
+inline float rowDistance(const SparseStore& store, uint32_t a, const float* b) {
+    if constexpr (std::is_same_v<Distance, ChiSquareDistance>) {
+        return store.chiSquare(a, b);
+    } else if constexpr (std::is_same_v<Distance, SqrtChiSquareDistance>) {
+        return std::sqrt(store.chiSquare(a, b));
+    } else {
+        thread_local std::vector<float> buf;
+        buf.resize(store.dims());
+        store.decode(a, buf.data());
+        return Distance::eval(buf.data(), b, store.dims());
+    }
+}
+
+template <class Distance>
+inline float rowDistance(const SparseStore& store, uint32_t a, uint32_t b) {
+    if constexpr (std::is_same_v<Distance, ChiSquareDistance>) {
+        return store.chiSquare(a, b);
+    } else if constexpr (std::is_same_v<Distance, SqrtChiSquareDistance>) {
+        return std::sqrt(store.chiSquare(a, b));
+    } else {
+        thread_local std::vector<float> other;
+        other.resize(store.dims());
+        store.decode(b, other.data());
+        return rowDistance<Distance>(store, a, other.data());
+    }
+}
+
+inline const float* rowVector(const SparseStore& store, uint32_t r, float* buf) {
+    store.decode(r, buf);
+    return buf;
+}
+
+using SparseMTree = BasicMTree<SqrtChiSquareDistance, SparseStore>;
+
+// ---- lista ---------------------------------------------------------------
+
+// k-NN exato (qui-quadrado) varrendo as linhas esparsas
+inline std::vector<Neighbor> searchKnnSparse(const SparseStore& store, const std::vector<uint32_t>& index,
+                                             const float* query, size_t k, QueryStats* stats = nullptr) {
+    QueryTimer timer(stats, QueryPhase::Total);
+    statAdd(stats, &QueryStats::distances, index.size());
+    const SparseQuery q(query, store.dims());
+    BoundedTopK<float> best(k);
+    for (uint32_t row : index) best.push(row, store.chiSquare(row, q));
+    return best.sorted();
+}
@@ -0,0 +1,375 @@
+// synthetic_dataset.hpp — base sintética grande (mistura de Dirichlet) direto no FeatureStore
+#pragma once
+#include "feature_store.hpp"
+#include "index_file.hpp"
+#include "search_hash.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* -----------------------------------------------------------------------------
+   O que faz:
+     - Gera histogramas normalizados de 512 bins agrupados, para testar as
+       estruturas na escala de milhões de linhas sem decodificar imagens.
+     - Modelo (mistura de Dirichlet em dois níveis):
+         semente s  = histograma real (images/) ou protótipo esparso sorteado;
+         centro c_k ~ Dirichlet(clusterConcentration * suavizado(s_{k mod S}));
+         linha      ~ Dirichlet(rowConcentration * c_k), k sorteado por linha.
+       Concentração maior = linhas mais parecidas com o centro. Bins com massa
+       desprezível no centro ficam zerados, como nos histogramas reais.
+     - Determinístico pela semente: cada linha tem seu próprio gerador
+       (semente, número da linha), então o resultado não depende do número de
+       threads nem da divisão do trabalho.
+     - As linhas são escritas em paralelo direto no store (sem cópia), ou
+       geradas em blocos durante a gravação do arquivo de índice
+       (index_file.hpp): só um bloco de linhas, os ids e as tabelas do hash
+       ficam na memória — o caminho para 1M-10M linhas.
+
+   API:
+     std::vector<float> centers = syntheticCenters(seedRows, dims, params);
+     SyntheticMixture mix = syntheticMixture(centers, dims, params.rowConcentration);
+     syntheticRow(mix, params, rowNumber, out);                   // uma linha
+     generateSynthetic(store, rows, seedRows, params, pool);      // N linhas
+     writeSyntheticIndex(path, rows, seedRows, params, pool, withLsh, &error);
+-----------------------------------------------------------------------------*/
+
+struct SyntheticParams
+{
+    uint64_t seed = 1;
+    size_t clusters = 1024;             // centros da mistura
+    float clusterConcentration = 60.0f; // centros em volta das sementes
+    float rowConcentration = 300.0f;    // linhas em volta dos centros
+    std::string idPrefix = "syn_";
+};
+
+// Gerador pequeno e rápido (splitmix64): um por linha
+struct SyntheticRng
+{
+    uint64_t state;
+    float spare = 0.0f;
+    bool hasSpare = false;
+
+    explicit SyntheticRng(uint64_t seed, uint64_t stream = 0)
+        : state(seed ^ (stream * 0xD1B54A32D192ED03ULL + 0x9E3779B97F4A7C15ULL)) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // uniforme em (0, 1)
+    float uniform() { return ((next() >> 40) + 0.5f) * (1.0f / 16777216.0f); }
+
+    // Marsaglia polar: cada par sorteado dá duas normais, a segunda fica guardada
+    float normal()
+    {
+        if (hasSpare)
+        {
+            hasSpare = false;
+            return spare;
+        }
+        for (;;)
+        {
+            float u = 2.0f * uniform() - 1.0f, v = 2.0f * uniform() - 1.0f;
+            float s = u * u + v * v;
+            if (s > 0.0f && s < 1.0f)
+            {
+                float m = std::sqrt(-2.0f * std::log(s) / s);
+                spare = v * m;
+                hasSpare = true;
+                return u * m;
+            }
+        }
+    }
+
+    // Gamma(shape, 1) por Marsaglia-Tsang; shape < 1 via Gamma(shape+1) * U^(1/shape)
+    float gamma(float shape)
+    {
+        float boost = 1.0f;
+        if (shape < 1.0f)
+        {
+            boost = std::pow(uniform(), 1.0f / shape);
+            shape += 1.0f;
+        }
+        const float d = shape - 1.0f / 3.0f;
+        return marsagliaTsang(d, 1.0f / std::sqrt(9.0f * d)) * boost;
+    }
+
+    // Gamma(d + 1/3, 1) com as constantes d e c = 1/sqrt(9d) já calculadas
+    float marsagliaTsang(float d, float c)
+    {
+        for (;;)
+        {
+            float x = normal(), v = 1.0f + c * x;
+            if (v <= 0.0f)
+                continue;
+            v = v * v * v;
+            float u = uniform(), x2 = x * x;
+            if (u < 1.0f - 0.0331f * x2 * x2 || std::log(u) < 0.5f * x2 + d * (1.0f - v + std::log(v)))
+                return d * v;
+        }
+    }
+};
+
+// Amostra Dirichlet(concentration * mean) em out; bins com média 0 ficam 0
+inline void sampleDirichlet(SyntheticRng &rng, const float *mean, size_t dims, float concentration, float *out)
+{
+    float total = 0.0f;
+    for (size_t b = 0; b < dims; b++)
+    {
+        out[b] = mean[b] > 0.0f ? rng.gamma(concentration * mean[b]) : 0.0f;
+        total += out[b];
+    }
+    if (total <= 0.0f)
+    {
+        for (size_t b = 0; b < dims; b++)
+            out[b] = mean[b];
+        return;
+    }
+    for (size_t b = 0; b < dims; b++)
+        out[b] /= total;
+}
+
+// Centros da mistura (clusters x dims). seedRows: histogramas normalizados
+// (ex.: das imagens); vazio = protótipos esparsos sorteados a partir da semente.
+inline std::vector<float> syntheticCenters(const std::vector<const float *> &seedRows, size_t dims,
+                                           const SyntheticParams &params)
+{
+    const size_t clusters = params.clusters ? params.clusters : 1;
+    std::vector<float> centers(clusters * dims), mean(dims);
+    for (size_t k = 0; k < clusters; k++)
+    {
+        SyntheticRng rng(params.seed, ~(uint64_t)k);
+        if (!seedRows.empty())
+        {
+            // semente real, com um pouco de massa espalhada para abrir bins novos
+            const float *s = seedRows[k % seedRows.size()];
+            for (size_t b = 0; b < dims; b++)
+                mean[b] = 0.98f * s[b] + 0.02f / dims;
+        }
+        else
+        {
+            // protótipo: ~30 bins dominantes, o resto com massa quase nula
+            for (size_t b = 0; b < dims; b++)
+                mean[b] = rng.uniform() < 30.0f / dims ? rng.gamma(2.0f) : 0.0f;
+            float total = 0.0f;
+            for (size_t b = 0; b < dims; b++)
+                total += mean[b];
+            for (size_t b = 0; b < dims; b++)
+                mean[b] = total > 0.0f ? 0.98f * mean[b] / total + 0.02f / dims : 1.0f / dims;
+        }
+        float *c = &centers[k * dims];
+        sampleDirichlet(rng, mean.data(), dims, params.clusterConcentration, c);
+        // massa abaixo de ~1 pixel em 100 mil: bin vazio nesse centro
+        for (size_t b = 0; b < dims; b++)
+            if (c[b] < 1e-5f)
+                c[b] = 0.0f;
+    }
+    return centers;
+}
+
+// Bin de um centro com a Gamma da linha já preparada (a forma é fixa por
+// centro e bin): só os bins com massa entram na lista
+struct SyntheticBin
+{
+    uint32_t bin;
+    float invShape;   // 1/forma (forma < 1) ou 0
+    float zeroBelow;  // U abaixo disso => valor < kSyntheticFloor: bin fica vazio
+    float d, c;       // constantes de Marsaglia-Tsang
+};
+
+// Valores de Gamma abaixo disso (frente a uma soma ~ rowConcentration) não
+// chegam a um pixel em milhões: o bin fica zerado sem sortear a normal
+static constexpr float kSyntheticFloor = 1e-4f;
+
+struct SyntheticMixture
+{
+    size_t dims = 0;
+    std::vector<uint32_t> first;      // bins do centro k: [first[k], first[k+1])
+    std::vector<SyntheticBin> bins;
+    std::vector<float> fallback;      // centro denso (linha degenerada, soma 0)
+
+    size_t clusters() const { return first.empty() ? 0 : first.size() - 1; }
+};
+
+inline SyntheticMixture syntheticMixture(const std::vector<float> &centers, size_t dims, float rowConcentration)
+{
+    SyntheticMixture mix;
+    mix.dims = dims;
+    mix.fallback = centers;
+    const size_t clusters = centers.size() / dims;
+    mix.first.push_back(0);
+    for (size_t k = 0; k < clusters; k++)
+    {
+        for (size_t b = 0; b < dims; b++)
+        {
+            float shape = rowConcentration * centers[k * dims + b];
+            if (shape <= 0.0f)
+                continue;
+            SyntheticBin e{(uint32_t)b, 0.0f, 0.0f, 0.0f, 0.0f};
+            if (shape < 1.0f)
+            {
+                // Gamma(a) = Gamma(a+1) * U^(1/a); com Gamma(a+1) ~ O(1), U^(1/a) < piso <=> U < piso^a
+                e.invShape = 1.0f / shape;
+                e.zeroBelow = std::pow(kSyntheticFloor, shape);
+                shape += 1.0f;
+            }
+            e.d = shape - 1.0f / 3.0f;
+            e.c = 1.0f / std::sqrt(9.0f * e.d);
+            mix.bins.push_back(e);
+        }
+        mix.first.push_back((uint32_t)mix.bins.size());
+    }
+    return mix;
+}
+
+// Linha número `row` da base (mesmo resultado para a mesma semente e linha)
+inline void syntheticRow(const SyntheticMixture &mix, const SyntheticParams &params, uint64_t row, float *out)
+{
+    SyntheticRng rng(params.seed, row);
+    const size_t k = rng.next() % mix.clusters();
+    for (size_t b = 0; b < mix.dims; b++)
+        out[b] = 0.0f;
+
+    float total = 0.0f;
+    for (uint32_t i = mix.first[k]; i < mix.first[k + 1]; i++)
+    {
+        const SyntheticBin &e = mix.bins[i];
+        float boost = 1.0f;
+        if (e.invShape > 0.0f)
+        {
+            float u = rng.uniform();
+            if (u < e.zeroBelow)
+                continue;
+            boost = std::pow(u, e.invShape);
+        }
+        float g = rng.marsagliaTsang(e.d, e.c) * boost;
+        out[e.bin] = g;
+        total += g;
+    }
+    if (total <= 0.0f)
+    {
+        for (size_t b = 0; b < mix.dims; b++)
+            out[b] = mix.fallback[k * mix.dims + b];
+        return;
+    }
+    const float inv = 1.0f / total;
+    for (size_t b = 0; b < mix.dims; b++)
+        out[b] *= inv;
+}
+
+// Acrescenta `rows` linhas sintéticas ao store (ids idPrefix + número), em paralelo
+inline void generateSynthetic(FeatureStore &store, size_t rows, const std::vector<const float *> &seedRows,
+                              const SyntheticParams &params, ThreadPool &pool)
+{
+    const size_t dims = store.dims();
+    const SyntheticMixture mix = syntheticMixture(syntheticCenters(seedRows, dims, params), dims,
+                                                  params.rowConcentration);
+
+    // linhas criadas antes das threads (add não é concorrente); a linha de
+    // número first + i tem o id e o gerador desse número, como no índice
+    const uint32_t first = store.size();
+    store.reserve((size_t)first + rows);
+    std::vector<uint32_t> target(rows);
+    for (size_t i = 0; i < rows; i++)
+        target[i] = store.add(params.idPrefix + std::to_string(first + i));
+
+    pool.parallelFor(0, rows, [&](int, size_t b, size_t e) {
+        for (size_t i = b; i < e; i++)
+            syntheticRow(mix, params, first + i, store.row(target[i]));
+    });
+}
+
+// Linhas por bloco gerado durante a gravação do índice (8 MB com 512 bins)
+static constexpr size_t kSyntheticWriteRows = 4096;
+
+// Grava um arquivo de índice com `rows` linhas sintéticas (ids idPrefix +
+// número). withLsh = também as tabelas do SimHashIndex (exigidas pelo modo query).
+inline bool writeSyntheticIndex(const std::string &path, size_t rows, const std::vector<const float *> &seedRows,
+                                const SyntheticParams &params, ThreadPool &pool, bool withLsh,
+                                std::string *error = nullptr)
+{
+    const size_t dims = FeatureStore::kDims;
+    if (rows == 0 || rows >= kNoRow)
+    {
+        if (error) *error = "numero de linhas invalido";
+        return false;
+    }
+    const SyntheticMixture mix = syntheticMixture(syntheticCenters(seedRows, dims, params), dims,
+                                                  params.rowConcentration);
+
+    // um bloco de linhas, reaproveitado: cada bloco é gerado, assinado e gravado
+    const size_t blockRows = std::min(rows, kSyntheticWriteRows);
+    std::unique_ptr<float, void (*)(void *)> block(
+        static_cast<float *>(std::aligned_alloc(FeatureStore::kAlign, blockRows * dims * sizeof(float))), std::free);
+    if (!block)
+    {
+        if (error) *error = "memoria insuficiente para o bloco de linhas";
+        return false;
+    }
+
+    std::vector<uint32_t> idOffsets(rows + 1);
+    std::vector<char> idChars;
+    idChars.reserve(rows * (params.idPrefix.size() + 8));
+    char digits[24];
+    for (size_t i = 0; i < rows; i++)
+    {
+        idOffsets[i] = (uint32_t)idChars.size();
+        idChars.insert(idChars.end(), params.idPrefix.begin(), params.idPrefix.end());
+        char *end = std::to_chars(digits, digits + sizeof(digits), i).ptr;
+        idChars.insert(idChars.end(), digits, end);
+    }
+    idOffsets[rows] = (uint32_t)idChars.size();
+
+    // FEAT é produzida durante write(); as assinaturas saem junto com cada
+    // bloco e SIGN/LSHT, gravadas depois de FEAT, já as encontram prontas
+    std::vector<Hash128> sigs(withLsh ? rows : 0);
+    IndexFileWriter writer(rows, (uint32_t)dims);
+    writer.addSection(kTagFeatures, (uint64_t)rows * dims * sizeof(float), [&](const IndexFileWriter::Sink &put) {
+        float *data = block.get();
+        for (size_t first = 0; first < rows; first += blockRows)
+        {
+            const size_t n = std::min(blockRows, rows - first);
+            pool.parallelFor(0, n, [&](int, size_t b, size_t e) {
+                std::vector<const float *> hists;
+                for (size_t i = b; i < e; i++)
+                {
+                    syntheticRow(mix, params, first + i, data + i * dims);
+                    hists.push_back(data + i * dims);
+                }
+                if (withLsh)
+                    sh_simhash128_batch(hists.data(), hists.size(), dims, sigs.data() + first + b);
+            });
+            put(data, (uint64_t)n * dims * sizeof(float));
+        }
+    });
+    writer.addSection(kTagIdOffsets, idOffsets.data(), idOffsets.size() * sizeof(uint32_t));
+    writer.addSection(kTagIdChars, idChars.data(), idChars.size());
+
+    // o hash só precisa de size() e das assinaturas: store sem linhas
+    FeatureStore store = FeatureStore::view(nullptr, (uint32_t)rows, dims, idOffsets.data(), idChars.data());
+    SimHashIndex hash(store);
+    SimHashIndexParams hashParams;
+    hashParams.bandBits = SimHashIndex::defaultBandBits(rows);   // a mesma escolha do build
+    const SimHashSectionHeader hashHeader = simHashSectionHeader(hashParams, rows);
+    if (withLsh)
+    {
+        writer.addSection(kTagSignatures, sigs.data(), (uint64_t)rows * sizeof(Hash128));
+        writer.addSection(kTagLshParams, &hashHeader, sizeof(hashHeader));
+        writer.addSection(kTagLshTables, (uint64_t)hashParams.tables * rows * sizeof(SimHashBucketEntry),
+                          [&](const IndexFileWriter::Sink &put) {
+                              hash.build(store.allRows(), sigs.data());
+                              put(hash.entries(), hash.entryCount() * sizeof(SimHashBucketEntry));
+                          });
+    }
+    return writer.write(path, error);
+}
@@ -0,0 +1,149 @@
+// thread_pool.hpp — pool fixo de threads e fila limitada produtor/consumidor
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Número de threads padrão: todos os núcleos (mínimo 1)
+inline int defaultThreadCount()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? (int)n : 1;
+}
+
+// Fila com capacidade máxima: push bloqueia quando cheia, pop quando vazia.
+// Depois de close(), pop devolve false assim que a fila esvaziar.
+template <class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+    void push(T value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [&] { return items_.size() < capacity_ || closed_; });
+        if (closed_)
+            return;
+        items_.push_back(std::move(value));
+        notEmpty_.notify_one();
+    }
+
+    bool pop(T &out)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [&] { return !items_.empty() || closed_; });
+        if (items_.empty())
+            return false;
+        out = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    bool closed_ = false;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_, notFull_;
+};
+
+// Pool fixo: submit() enfileira tarefas, wait() bloqueia até todas terminarem
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads = defaultThreadCount())
+    {
+        if (threads < 1)
+            threads = 1;
+        for (int t = 0; t < threads; t++)
+            workers_.emplace_back([this] { run(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        hasWork_.notify_all();
+        for (auto &w : workers_)
+            w.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const { return (int)workers_.size(); }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+            pending_++;
+        }
+        hasWork_.notify_one();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        allDone_.wait(lock, [&] { return pending_ == 0; });
+    }
+
+    // Divide [begin, end) em um bloco por thread: fn(worker, blockBegin, blockEnd)
+    template <class Fn>
+    void parallelFor(size_t begin, size_t end, Fn fn)
+    {
+        size_t n = end > begin ? end - begin : 0;
+        size_t parts = (size_t)size() < n ? (size_t)size() : n;
+        for (size_t p = 0; p < parts; p++)
+        {
+            size_t b = begin + n * p / parts, e = begin + n * (p + 1) / parts;
+            submit([fn, p, b, e] { fn((int)p, b, e); });
+        }
+        wait();
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                hasWork_.wait(lock, [&] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty())
+                    return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0)
+                allDone_.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    size_t pending_ = 0;
+    bool stopping_ = false;
+    std::mutex mutex_;
+    std::condition_variable hasWork_, allDone_;
+};
@@ -0,0 +1,75 @@
+// top_k.hpp — seleção dos k melhores com heap limitado
+#pragma once
+#include "feature_store.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+// Linha do FeatureStore com sua distância (float = qui-quadrado, int = Hamming)
+template <class D>
+struct ScoredRow {
+    uint32_t row;
+    D distance;
+};
+
+using Neighbor = ScoredRow<float>;
+
+// Mantém os k menores (distância, linha) vistos: max-heap de tamanho k,
+// O(log k) por inserção aceita e O(1) para rejeitar quem não entra.
+template <class D>
+class BoundedTopK {
+public:
+    explicit BoundedTopK(size_t k) : k_(k) { heap_.reserve(k); }
+
+    size_t capacity() const { return k_; }
+    size_t size() const { return heap_.size(); }
+    bool full() const { return heap_.size() >= k_; }
+
+    // Pior distância aceita no momento (infinito/máximo enquanto não está cheio)
+    D worst() const {
+        if (!full() || heap_.empty()) return std::numeric_limits<D>::has_infinity
+                                               ? std::numeric_limits<D>::infinity()
+                                               : std::numeric_limits<D>::max();
+        return heap_.front().distance;
+    }
+
+    bool push(uint32_t row, D distance) {
+        if (k_ == 0) return false;
+        ScoredRow<D> item{row, distance};
+        if (!full()) {
+            heap_.push_back(item);
+            std::push_heap(heap_.begin(), heap_.end(), less);
+            return true;
+        }
+        if (!less(item, heap_.front())) return false;
+        std::pop_heap(heap_.begin(), heap_.end(), less);
+        heap_.back() = item;
+        std::push_heap(heap_.begin(), heap_.end(), less);
+        return true;
+    }
+
+    // Resultado em ordem crescente de distância (desempate pela linha)
+    std::vector<ScoredRow<D>> sorted() const {
+        std::vector<ScoredRow<D>> out = heap_;
+        std::sort_heap(out.begin(), out.end(), less);
+        return out;
+    }
+
+private:
+    static bool less(const ScoredRow<D>& a, const ScoredRow<D>& b) {
+        return a.distance < b.distance || (a.distance == b.distance && a.row < b.row);
+    }
+
+    size_t k_;
+    std::vector<ScoredRow<D>> heap_;
+};
+
+// Imprime uma lista de vizinhos (k-NN / range) já ordenada
+inline void printNeighbors(const FeatureStore& store, const std::vector<Neighbor>& hits) {
+    if (hits.empty()) { std::cout << "Nenhum item encontrado.\n"; return; }
+    for (size_t i = 0; i < hits.size(); i++)
+        std::cout << i + 1 << ") " << store.id(hits[i].row) << " | dist = " << hits[i].distance << "\n";
+}